@@ -21,20 +21,26 @@
 
 // ITK
 #include "itkCastImageFilter.h"
-#include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 #include "itkRegionOfInterestImageFilter.h"
-#include "itkVector.h"
-#include "itkDeformationFieldSource.h"
-#include "itkDeformationFieldTransform.h"
-#include "itkResampleVectorImageFilter.h"
 
 // Qt
 #include <QFileDialog>
 #include <QIcon>
+#include <QLabel>
+#include <QTimer>
+
+// STL
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <limits>
+#include <sstream>
 
 // VTK
 #include <vtkActor.h>
+#include <vtkCallbackCommand.h>
 #include <vtkCommand.h>
 #include <vtkDataSetSurfaceFilter.h>
 #include <vtkImageActor.h>
@@ -58,8 +64,98 @@
 
 // Custom
 #include "Helpers.h"
+#include "IntensityRefinement.h"
+#include "LandmarkRefinement.h"
+#include "LandmarkRegistration.h"
+#include "PrecisionPolicy.h"
 #include "Types.h"
 
+// Refine the field of a 2D registration against the image content, and resample the original moving image once more
+// through the refined field. Returns false if the field is not a field of TPrecision.
+template <typename TPrecision>
+static bool RefineRegistration(FloatVectorImageType* fixedImage, FloatVectorImageType* movingImage,
+                               itk::DataObject::Pointer& deformationField, FloatVectorImageType::Pointer& transformedImage)
+{
+  typedef typename PrecisionTypes<2, TPrecision>::DeformationFieldType DeformationFieldType;
+  typename DeformationFieldType::Pointer typedField = dynamic_cast<DeformationFieldType*>(deformationField.GetPointer());
+  if(!typedField)
+    {
+    return false;
+    }
+
+  typename DeformationFieldType::Pointer refinedField =
+    IntensityRefinement::RefineDeformationField<DeformationFieldType>(fixedImage, transformedImage, movingImage,
+                                                                      typedField);
+  transformedImage = LandmarkRegistration::WarpImage<2, TPrecision>(movingImage, refinedField, fixedImage);
+  deformationField = refinedField.GetPointer();
+  return true;
+}
+
+// Resample the moving image once more through the field of an earlier registration, without recomputing the field
+// (or refining it again). Returns NULL if the field is not a field of TPrecision.
+template <typename TPrecision>
+static FloatVectorImageType::Pointer WarpThroughField(itk::DataObject* deformationField, FloatVectorImageType* movingImage,
+                                                      const FloatVectorImageType* fixedImage)
+{
+  typedef typename PrecisionTypes<2, TPrecision>::DeformationFieldType DeformationFieldType;
+  DeformationFieldType* typedField = dynamic_cast<DeformationFieldType*>(deformationField);
+  if(!typedField)
+    {
+    return NULL;
+    }
+  return LandmarkRegistration::WarpImage<2, TPrecision>(movingImage, typedField, fixedImage);
+}
+
+// Map moving points into fixed space through the inverse of 'deformationField'. The inverse is computed on first
+// use. Returns false if the field is not a TDeformationField.
+template <typename TDeformationField>
+static bool MapPointsToFixed(const itk::DataObject* deformationField, itk::DataObject::Pointer& inverseDeformationField,
+                             const FloatVectorImageType* movingImage, std::vector<ImageTypes<2>::PointType>& points)
+{
+  const TDeformationField* forwardField = dynamic_cast<const TDeformationField*>(deformationField);
+  if(!forwardField)
+    {
+    return false;
+    }
+
+  if(!inverseDeformationField)
+    {
+    inverseDeformationField = LandmarkRegistration::ComputeInverseDeformationField(forwardField, movingImage).GetPointer();
+    }
+  points = LandmarkRegistration::TransformPoints(dynamic_cast<TDeformationField*>(inverseDeformationField.GetPointer()),
+                                                 points);
+  return true;
+}
+
+// The lengths of the leave-one-out errors (physical vectors) in pixels of 'movingImage'
+template <typename TImage, typename TVector>
+static std::vector<double> ComputeErrorsInPixels(const TImage* movingImage, const std::vector<TVector>& errors)
+{
+  std::vector<double> errorsInPixels(errors.size());
+  for(unsigned int i = 0; i < errors.size(); ++i)
+    {
+    double squaredLength = 0;
+    for(unsigned int j = 0; j < TVector::Dimension; ++j)
+      {
+      const double component = errors[i][j] / movingImage->GetSpacing()[j];
+      squaredLength += component * component;
+      }
+    errorsInPixels[i] = std::sqrt(squaredLength);
+    }
+  return errorsInPixels;
+}
+
+static void ClearLandmarkErrorsCallback(vtkObject*, unsigned long, void* form, void*)
+{
+  static_cast<Form*>(form)->ClearLandmarkErrors();
+}
+
+static void UpdateSeedColorsCallback(vtkObject*, unsigned long, void* form, void*)
+{
+  // A seed that is being deleted is still there, so the colors are updated once the widget is done
+  QTimer::singleShot(0, static_cast<Form*>(form), SLOT(slot_UpdateSeedColors()));
+}
+
 // Constructor
 Form::Form()
 {
@@ -104,77 +200,127 @@ Form::Form()
   this->MovingHandleRepresentation->GetProperty()->SetColor(1,0,0);
   this->MovingSeedRepresentation = vtkSmartPointer<vtkSeedRepresentation>::New();
   this->MovingSeedRepresentation->SetHandleRepresentation(this->MovingHandleRepresentation);
+
+  // The image memory budget can be set (in MB) through the environment
+  const char* memoryBudget = getenv("IIR_MEMORY_BUDGET_MB");
+  if(memoryBudget)
+    {
+    char* end = NULL;
+    errno = 0;
+    const unsigned long long megabytes = strtoull(memoryBudget, &end, 10);
+    if(end == memoryBudget || *end != '\0' || errno == ERANGE || memoryBudget[0] == '-' ||
+       megabytes > std::numeric_limits<unsigned long long>::max() / (1024 * 1024))
+      {
+      std::cerr << "Ignoring IIR_MEMORY_BUDGET_MB=" << memoryBudget << ", which is not a number of megabytes."
+                << " Keeping the default budget." << std::endl;
+      }
+    else
+      {
+      this->MemoryManager.SetBudget(megabytes * 1024 * 1024);
+      }
+    }
+  this->MemoryLabel = new QLabel;
+  this->statusbar->addPermanentWidget(this->MemoryLabel);
+
+  // The slice sliders are only shown for volumes
+  this->sldFixedSlice->hide();
+  this->sldMovingSlice->hide();
+  this->FixedMagnitudeRange[0] = this->FixedMagnitudeRange[1] = 0;
+  this->MovingMagnitudeRange[0] = this->MovingMagnitudeRange[1] = 0;
+
+  // Seeds mapped from the moving image are drawn as green points over the fixed image
+  this->MappedPointsGlyphFilter = vtkSmartPointer<vtkVertexGlyphFilter>::New();
+  vtkSmartPointer<vtkPolyDataMapper> mappedPointsMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+  mappedPointsMapper->SetInputConnection(this->MappedPointsGlyphFilter->GetOutputPort());
+  this->MappedPointsActor = vtkSmartPointer<vtkActor>::New();
+  this->MappedPointsActor->SetMapper(mappedPointsMapper);
+  this->MappedPointsActor->GetProperty()->SetColor(0, 1, 0);
+  this->MappedPointsActor->GetProperty()->SetPointSize(5);
+
+  // The combo box lists the policies in the order of PrecisionPolicyType
+  this->cmbPrecision->setCurrentIndex(IIR_DEFAULT_PRECISION);
 };
 
+Form::~Form()
+{
+  // Loaders still running (including ones that were replaced) are children of the window. They must finish before
+  // they are destroyed, and must not call back into the half destroyed window when they do.
+  QList<ImageLoader*> loaders = this->findChildren<ImageLoader*>();
+  for(int i = 0; i < loaders.size(); ++i)
+    {
+    disconnect(loaders[i], 0, this, 0);
+    loaders[i]->wait();
+    }
+}
+
 void Form::on_btnRegister_clicked()
 {
-  if(this->MovingSeedRepresentation->GetNumberOfSeeds() !=
-     this->FixedSeedRepresentation->GetNumberOfSeeds())
+  // Each fixed seed pairs with the moving seed of the same id. Moving seeds after the pairs are only mapped (see
+  // on_btnMapSeeds_clicked), and are not registered.
+  const int numberOfPairs = this->FixedSeedRepresentation->GetNumberOfSeeds();
+  if(this->MovingSeedRepresentation->GetNumberOfSeeds() < numberOfPairs)
   {
-    std::cerr << "The number of fixed seeds must match the number of moving seeds!" << std::endl;
+    std::cerr << "Each fixed seed needs a moving seed!" << std::endl;
     return;
   }
-  
-  //typedef   itk::Vector< float, 2 >    VectorType;
-  typedef   itk::Vector< double, 2 >    VectorType;
-  typedef   itk::Image< VectorType, 2 >   DeformationFieldType;
-  
-  typedef itk::DeformationFieldSource<DeformationFieldType>  DeformationFieldSourceType;
-  DeformationFieldSourceType::Pointer deformationFieldSource = DeformationFieldSourceType::New();
-  deformationFieldSource->SetOutputSpacing( this->FixedImage->GetSpacing() );
-  deformationFieldSource->SetOutputOrigin(  this->FixedImage->GetOrigin() );
-  deformationFieldSource->SetOutputRegion(  this->FixedImage->GetLargestPossibleRegion() );
-  deformationFieldSource->SetOutputDirection( this->FixedImage->GetDirection() );
-
-  //  Create source and target landmarks.
-  typedef DeformationFieldSourceType::LandmarkContainerPointer   LandmarkContainerPointer;
-  typedef DeformationFieldSourceType::LandmarkContainer          LandmarkContainerType;
-  typedef DeformationFieldSourceType::LandmarkPointType          LandmarkPointType;
-
-  LandmarkContainerType::Pointer fixedLandmarks = LandmarkContainerType::New();
-  LandmarkContainerType::Pointer movingLandmarks = LandmarkContainerType::New();
-
-  LandmarkPointType movingPoint;
-  LandmarkPointType fixedPoint;
-
-  for(vtkIdType i = 0; i < this->FixedSeedRepresentation->GetNumberOfSeeds(); i++)
-    {
-    double fixedPos[3];
-    this->FixedSeedRepresentation->GetSeedDisplayPosition(i, fixedPos);
-    fixedPoint[0] = 40;
-    fixedPoint[1] = 40;
-    fixedLandmarks->InsertElement( i, fixedPoint );
-  
-    double movingPos[3];
-    this->MovingSeedRepresentation->GetSeedDisplayPosition(i, movingPos);
-    movingPoint[0] = 20;
-    movingPoint[1] = 20;
-    movingLandmarks->InsertElement( i, movingPoint );
+  if(this->MovingSeedRepresentation->GetNumberOfSeeds() > numberOfPairs)
+    {
+    std::cout << "Registering " << numberOfPairs << " landmark pairs. The "
+              << this->MovingSeedRepresentation->GetNumberOfSeeds() - numberOfPairs
+              << " moving seeds after them are for mapping only." << std::endl;
     }
 
-  deformationFieldSource->SetSourceLandmarks( movingLandmarks.GetPointer() );
-  deformationFieldSource->SetTargetLandmarks( fixedLandmarks.GetPointer() );
-  deformationFieldSource->UpdateLargestPossibleRegion();
-  
-  //typedef itk::DeformationFieldTransform<float, 2>  DeformationFieldTransformType;
-  typedef itk::DeformationFieldTransform<double, 2>  DeformationFieldTransformType;
-  DeformationFieldTransformType::Pointer deformationFieldTransform = DeformationFieldTransformType::New();
-  deformationFieldTransform->SetDeformationField( deformationFieldSource->GetOutput() );
-  
-  //typedef itk::ResampleVectorImageFilter<FloatVectorImageType, FloatVectorImageType, float >    VectorResampleFilterType;
-  typedef itk::ResampleVectorImageFilter<FloatVectorImageType, FloatVectorImageType>    VectorResampleFilterType;
-  VectorResampleFilterType::Pointer vectorResampleFilter = VectorResampleFilterType::New();
-  vectorResampleFilter->SetInput( this->MovingImage );
-  vectorResampleFilter->SetTransform( deformationFieldTransform );
-  vectorResampleFilter->SetSize( this->FixedImage->GetLargestPossibleRegion().GetSize() );
-  vectorResampleFilter->SetOutputOrigin(  this->FixedImage->GetOrigin() );
-  vectorResampleFilter->SetOutputSpacing( this->FixedImage->GetSpacing() );
-  vectorResampleFilter->SetOutputDirection( this->FixedImage->GetDirection() );
-  vectorResampleFilter->SetDefaultPixelValue( 200 ); // This is the color which to set portions of the transformed image that do not correspond to the moving image
-  vectorResampleFilter->Update();
+  if(this->FixedVolume && this->MovingVolume)
+    {
+    RegisterVolumes();
+    return;
+    }
+
+  if(!this->FixedImage || !this->MovingImage)
+    {
+    std::cerr << "Both images must be loaded, and must both be images or both be volumes, before registering!" << std::endl;
+    return;
+    }
   
-  this->TransformedImage = FloatVectorImageType::New();
-  Helpers::DeepCopyVectorImage<FloatVectorImageType>(vectorResampleFilter->GetOutput(), this->TransformedImage);
+  std::vector<ContinuousIndexType> fixedSeeds = Helpers::GetSeedIndices(this->FixedSeedRepresentation);
+  std::vector<ContinuousIndexType> movingSeeds = Helpers::GetSeedIndices(this->MovingSeedRepresentation);
+  movingSeeds.resize(fixedSeeds.size());
+
+  if(this->chkRefineLandmarks->isChecked())
+    {
+    unsigned int numberRefined = LandmarkRefinement::RefineMovingLandmarks(this->FixedImage, this->MovingImage,
+                                                                           fixedSeeds, movingSeeds);
+    std::cout << "Refined " << numberRefined << " of " << movingSeeds.size() << " moving landmarks." << std::endl;
+
+    // Show the user where the moving seeds ended up
+    Helpers::SetSeedIndices(this->MovingSeedWidget, movingSeeds);
+    this->qvtkWidgetRight->GetRenderWindow()->Render();
+    }
+
+  std::vector<ImageTypes<2>::PointType> fixedLandmarks(fixedSeeds.size());
+  std::vector<ImageTypes<2>::PointType> movingLandmarks(movingSeeds.size());
+  for(unsigned int i = 0; i < fixedSeeds.size(); i++)
+    {
+    this->FixedImage->TransformContinuousIndexToPhysicalPoint(fixedSeeds[i], fixedLandmarks[i]);
+    this->MovingImage->TransformContinuousIndexToPhysicalPoint(movingSeeds[i], movingLandmarks[i]);
+    }
+
+  std::vector<DeformationVectorType> leaveOneOutErrors;
+  this->InverseDeformationField = NULL;
+  this->LeftRenderer->RemoveActor(this->MappedPointsActor);
+  this->TransformedImage =
+    LandmarkRegistration::RegisterImage<2>(this->FixedImage, this->MovingImage, fixedLandmarks, movingLandmarks,
+                                           static_cast<PrecisionPolicyType>(this->cmbPrecision->currentIndex()),
+                                           &leaveOneOutErrors, &this->DeformationField);
+
+  // The float field serves both the float and the mixed precision policies, which resample alike
+  if(this->chkRefineIntensity->isChecked() &&
+     !RefineRegistration<DoublePrecision>(this->FixedImage, this->MovingImage, this->DeformationField, this->TransformedImage) &&
+     !RefineRegistration<FloatPrecision>(this->FixedImage, this->MovingImage, this->DeformationField, this->TransformedImage))
+    {
+    std::cerr << "Unknown deformation field type!" << std::endl;
+    }
+  ShowLandmarkErrors(ComputeErrorsInPixels(this->MovingImage.GetPointer(), leaveOneOutErrors), 2);
     
   if(this->chkRGB->isChecked())
     {
@@ -189,6 +335,18 @@ void Form::on_btnRegister_clicked()
 
   // Add Actor to renderer
   this->LeftRenderer->AddActor(this->TransformedImageActor);
+
+  // The transformed image covers the fixed image, so the fixed display buffer can go until ShowFixedDisplay()
+  // converts it again. The transformed image itself is only needed again for saving, and can be resampled from
+  // the field for that.
+  this->FixedImageActor->VisibilityOff();
+  this->MemoryManager.SetPinned("Fixed display", false);
+  this->MemoryManager.Track("Transformed image", this->TransformedImage, ImageMemoryManager::IntermediateBuffer);
+  this->MemoryManager.SetPinned("Transformed image", false);
+  this->MemoryManager.Track("Transformed display", this->TransformedImageData, ImageMemoryManager::DisplayBuffer);
+  // The field stays pinned: saving and seed mapping need it, and it could only be recomputed by registering again
+  this->MemoryManager.Track("Deformation field", this->DeformationField, ImageMemoryManager::IntermediateBuffer);
+  UpdateMemoryUsage();
   
   this->qvtkWidgetLeft->GetInteractor()->GetRenderWindow()->Render();
   this->LeftRenderer->Render();
@@ -196,58 +354,260 @@ void Form::on_btnRegister_clicked()
   //this->LeftRenderer->ResetCamera();
 }
 
-void Form::on_actionOpenMovingImage_activated()
+void Form::on_btnMapSeeds_clicked()
 {
-   // Get a filename to open
-  QString fileName = QFileDialog::getOpenFileName(this, "Open File", ".", "Image Files (*.png *.mhd *.tif)");
+  if(!this->DeformationField || !this->FixedImage || !this->MovingImage)
+    {
+    std::cerr << "Register the images first! Mapping seeds is only available for 2D images." << std::endl;
+    return;
+    }
 
-  std::cout << "Got filename: " << fileName.toStdString() << std::endl;
-  if(fileName.toStdString().empty())
+  // The moving seeds after the registered pairs are the ones to map
+  const unsigned int numberOfPairs = this->FixedSeedRepresentation->GetNumberOfSeeds();
+  std::vector<ContinuousIndexType> movingSeeds = Helpers::GetSeedIndices(this->MovingSeedRepresentation);
+  if(movingSeeds.size() <= numberOfPairs)
     {
-    std::cout << "Filename was empty." << std::endl;
+    std::cerr << "Place the moving seeds to map after the " << numberOfPairs << " registered pairs." << std::endl;
     return;
     }
 
-  typedef itk::ImageFileReader<FloatVectorImageType> ReaderType;
-  ReaderType::Pointer reader = ReaderType::New();
-  reader->SetFileName(fileName.toStdString());
-  reader->Update();
-  
-  this->MovingImage = reader->GetOutput();
+  std::vector<ImageTypes<2>::PointType> points(movingSeeds.size() - numberOfPairs);
+  for(unsigned int i = 0; i < points.size(); ++i)
+    {
+    this->MovingImage->TransformContinuousIndexToPhysicalPoint(movingSeeds[numberOfPairs + i], points[i]);
+    }
 
-  if(this->chkRGB->isChecked())
+  // The inverse is kept for the next mapping, unless it was evicted to stay within the memory budget
+  if(this->InverseDeformationField && !this->MemoryManager.IsResident("Inverse deformation field"))
     {
-    Helpers::ITKImagetoVTKRGBImage(this->MovingImage, this->MovingImageData);
+    this->InverseDeformationField = NULL;
+    }
+
+  typedef PrecisionTypes<2, FloatPrecision>::DeformationFieldType FloatDeformationFieldType;
+  if(!MapPointsToFixed<DeformationFieldType>(this->DeformationField, this->InverseDeformationField, this->MovingImage, points) &&
+     !MapPointsToFixed<FloatDeformationFieldType>(this->DeformationField, this->InverseDeformationField, this->MovingImage, points))
+    {
+    std::cerr << "Unknown deformation field type!" << std::endl;
+    return;
+    }
+  this->MemoryManager.Track("Inverse deformation field", this->InverseDeformationField, ImageMemoryManager::IntermediateBuffer);
+  this->MemoryManager.SetPinned("Inverse deformation field", false);
+  UpdateMemoryUsage();
+
+  // The mapped points are shown apart from the fixed seeds, so that they don't become landmarks of the next registration
+  vtkSmartPointer<vtkPoints> fixedPoints = vtkSmartPointer<vtkPoints>::New();
+  for(unsigned int i = 0; i < points.size(); ++i)
+    {
+    ContinuousIndexType fixedIndex;
+    this->FixedImage->TransformPhysicalPointToContinuousIndex(points[i], fixedIndex);
+    fixedPoints->InsertNextPoint(fixedIndex[0], fixedIndex[1], 0);
+    }
+  vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+  polyData->SetPoints(fixedPoints);
+  this->MappedPointsGlyphFilter->SetInput(polyData);
+  this->MappedPointsGlyphFilter->Update();
+  this->LeftRenderer->AddActor(this->MappedPointsActor);
+  this->qvtkWidgetLeft->GetRenderWindow()->Render();
+
+  std::cout << "Mapped " << points.size() << " moving seeds to the fixed image." << std::endl;
+}
+
+void Form::RegisterVolumes(const bool keepPinned)
+{
+  if(this->chkRefineLandmarks->isChecked() || this->chkRefineIntensity->isChecked())
+    {
+    std::cout << "Refinement is only available for 2D images, registering the volumes with the landmarks only." << std::endl;
+    }
+
+  // The seeds are picked on slices. Their slice is the third index.
+  std::vector<ContinuousIndexType> fixedSeeds = Helpers::GetSeedIndices(this->FixedSeedRepresentation);
+  std::vector<ContinuousIndexType> movingSeeds = Helpers::GetSeedIndices(this->MovingSeedRepresentation);
+  movingSeeds.resize(fixedSeeds.size());
+
+  std::vector<ImageTypes<3>::PointType> fixedLandmarks(fixedSeeds.size());
+  std::vector<ImageTypes<3>::PointType> movingLandmarks(movingSeeds.size());
+  for(unsigned int i = 0; i < fixedSeeds.size(); i++)
+    {
+    VolumeContinuousIndexType fixedIndex;
+    fixedIndex[0] = fixedSeeds[i][0];
+    fixedIndex[1] = fixedSeeds[i][1];
+    fixedIndex[2] = this->FixedSeedCallback->GetSeedSlice(i);
+    this->FixedVolume->TransformContinuousIndexToPhysicalPoint(fixedIndex, fixedLandmarks[i]);
+
+    VolumeContinuousIndexType movingIndex;
+    movingIndex[0] = movingSeeds[i][0];
+    movingIndex[1] = movingSeeds[i][1];
+    movingIndex[2] = this->MovingSeedCallback->GetSeedSlice(i);
+    this->MovingVolume->TransformContinuousIndexToPhysicalPoint(movingIndex, movingLandmarks[i]);
+    }
+
+  std::vector<ImageTypes<3>::DeformationVectorType> leaveOneOutErrors;
+  this->TransformedVolume =
+    LandmarkRegistration::RegisterImage<3>(this->FixedVolume, this->MovingVolume, fixedLandmarks, movingLandmarks,
+                                           static_cast<PrecisionPolicyType>(this->cmbPrecision->currentIndex()),
+                                           &leaveOneOutErrors);
+  ShowLandmarkErrors(ComputeErrorsInPixels(this->MovingVolume.GetPointer(), leaveOneOutErrors), 3);
+
+  this->MemoryManager.Track("Transformed volume", this->TransformedVolume, ImageMemoryManager::IntermediateBuffer);
+  this->MemoryManager.Track("Transformed display", this->TransformedImageData, ImageMemoryManager::DisplayBuffer);
+
+  // Only the slice on screen is converted, the slider converts the others as they are shown
+  this->TransformedImageActor->SetInput(this->TransformedImageData);
+  this->LeftRenderer->AddActor(this->TransformedImageActor);
+  this->FixedImageActor->VisibilityOff();
+  this->MemoryManager.SetPinned("Fixed display", false);
+  on_sldFixedSlice_valueChanged(this->sldFixedSlice->value());
+
+  // Once its slice is converted, the volume itself can be evicted. The slider then says so instead of registering
+  // again, and saving registers again.
+  if(!keepPinned)
+    {
+    this->MemoryManager.SetPinned("Transformed volume", false);
+    }
+  UpdateMemoryUsage();
+}
+
+void Form::ClearLandmarkErrors()
+{
+  // The errors belong to the fit of all the pairs, so they are all stale once any seed changes
+  vtkSeedCallback* callbacks[] = {this->FixedSeedCallback, this->MovingSeedCallback};
+  vtkSeedRepresentation* representations[] = {this->FixedSeedRepresentation, this->MovingSeedRepresentation};
+  for(unsigned int side = 0; side < 2; ++side)
+    {
+    if(!callbacks[side])
+      {
+      continue;
+      }
+    for(int seedId = 0; seedId < representations[side]->GetNumberOfSeeds(); ++seedId)
+      {
+      callbacks[side]->SetSeedNote(seedId, "");
+      }
+    }
+}
+
+void Form::ShowLandmarkErrors(const std::vector<double>& errors, const unsigned int dimension)
+{
+  const unsigned int numberOfSeeds = this->FixedSeedRepresentation->GetNumberOfSeeds();
+  if(numberOfSeeds < dimension + 2)
+    {
+    std::cout << "No leave-one-out errors: they need at least " << dimension + 2 << " landmark pairs, there are "
+              << numberOfSeeds << "." << std::endl;
+    }
+  else if(errors.size() != numberOfSeeds)
+    {
+    std::cout << "No leave-one-out errors: the landmarks are degenerate (e.g. coincident or collinear)." << std::endl;
+    }
+
+  unsigned int worstSeed = 0;
+  for(unsigned int seedId = 0; seedId < numberOfSeeds; ++seedId)
+    {
+    std::string note;
+    if(seedId < errors.size())
+      {
+      std::stringstream ss;
+      ss << "(" << std::fixed << std::setprecision(1) << errors[seedId] << "px)";
+      note = ss.str();
+      if(errors[seedId] > errors[worstSeed])
+        {
+        worstSeed = seedId;
+        }
+      }
+    this->FixedSeedCallback->SetSeedNote(seedId, note);
+    this->MovingSeedCallback->SetSeedNote(seedId, note);
+    }
+
+  if(!errors.empty())
+    {
+    std::cout << "Largest leave-one-out error: landmark " << worstSeed << ", " << errors[worstSeed] << " pixels." << std::endl;
+    }
+
+  this->qvtkWidgetLeft->GetRenderWindow()->Render();
+  this->qvtkWidgetRight->GetRenderWindow()->Render();
+}
+
+void Form::on_sldFixedSlice_valueChanged(int slice)
+{
+  if(!this->FixedVolume)
+    {
+    return;
+    }
+
+  if(this->FixedSeedCallback)
+    {
+    this->FixedSeedCallback->SetSlice(slice);
+    }
+
+  // The left view shows the transformed volume once there is one. It is resampled on the fixed grid, so
+  // the slices line up, and its intensities are the moving ones.
+  if(this->TransformedVolume)
+    {
+    // It may have been evicted to stay within the memory budget. Registering again would only evict it again.
+    if(!this->MemoryManager.IsResident("Transformed volume"))
+      {
+      this->statusbar->showMessage("The transformed volume was evicted to stay within the memory budget. Register again to show it.");
+      return;
+      }
+    this->MemoryManager.Touch("Transformed volume");
+    Helpers::ITKVolumeSlicetoVTKImage(this->TransformedVolume, slice, this->chkRGB->isChecked(),
+                                      this->MovingMagnitudeRange[0], this->MovingMagnitudeRange[1], this->TransformedImageData);
     }
   else
     {
-    Helpers::ITKImagetoVTKMagnitudeImage(this->MovingImage, this->MovingImageData);
+    Helpers::ITKVolumeSlicetoVTKImage(this->FixedVolume, slice, this->chkRGB->isChecked(),
+                                      this->FixedMagnitudeRange[0], this->FixedMagnitudeRange[1], this->FixedImageData);
     }
-  
-  this->MovingImageActor->SetInput(this->MovingImageData);
 
-  // Add Actor to renderer
-  this->RightRenderer->AddActor(this->MovingImageActor);
-  this->RightRenderer->ResetCamera();
+  this->qvtkWidgetLeft->GetRenderWindow()->Render();
+}
 
-  vtkSmartPointer<vtkInteractorStyleImage> interactorStyle =
-      vtkSmartPointer<vtkInteractorStyleImage>::New();
-  this->qvtkWidgetRight->GetRenderWindow()->GetInteractor()->SetInteractorStyle(interactorStyle);
+void Form::on_sldMovingSlice_valueChanged(int slice)
+{
+  if(!this->MovingVolume)
+    {
+    return;
+    }
 
-  this->RightRenderer->ResetCamera();
+  if(this->MovingSeedCallback)
+    {
+    this->MovingSeedCallback->SetSlice(slice);
+    }
 
-  
-  // Seed widget
-  this->MovingSeedWidget = vtkSmartPointer<vtkSeedWidget>::New();
-  this->MovingSeedWidget->SetInteractor(this->qvtkWidgetRight->GetRenderWindow()->GetInteractor());
-  this->MovingSeedWidget->SetRepresentation(this->MovingSeedRepresentation);
-  
-  this->MovingSeedCallback = vtkSmartPointer<vtkSeedCallback>::New();
-  this->MovingSeedCallback->SetWidget(this->MovingSeedWidget);
-  
-  this->MovingSeedWidget->AddObserver(vtkCommand::PlacePointEvent,this->MovingSeedCallback);
-  this->MovingSeedWidget->AddObserver(vtkCommand::InteractionEvent,this->MovingSeedCallback);
-  this->MovingSeedWidget->On();
+  Helpers::ITKVolumeSlicetoVTKImage(this->MovingVolume, slice, this->chkRGB->isChecked(),
+                                    this->MovingMagnitudeRange[0], this->MovingMagnitudeRange[1], this->MovingImageData);
+
+  this->qvtkWidgetRight->GetRenderWindow()->Render();
+}
+
+void Form::ShowVolumeSlider(QSlider* slider, FloatVectorVolumeType* volume)
+{
+  if(!volume)
+    {
+    slider->hide();
+    return;
+    }
+
+  // Start in the middle, which is the slice the loader converted
+  const int numberOfSlices = volume->GetLargestPossibleRegion().GetSize()[2];
+  slider->blockSignals(true);
+  slider->setRange(0, numberOfSlices - 1);
+  slider->setValue(numberOfSlices / 2);
+  slider->blockSignals(false);
+  slider->show();
+}
+
+void Form::on_actionOpenMovingImage_activated()
+{
+   // Get a filename to open
+  QString fileName = QFileDialog::getOpenFileName(this, "Open File", ".", "Image Files (*.png *.mhd *.tif)");
+
+  std::cout << "Got filename: " << fileName.toStdString() << std::endl;
+  if(fileName.toStdString().empty())
+    {
+    std::cout << "Filename was empty." << std::endl;
+    return;
+    }
+
+  LoadMovingImage(fileName.toStdString());
 }
 
 void Form::on_actionOpenFixedImage_activated()
@@ -262,59 +622,346 @@ void Form::on_actionOpenFixedImage_activated()
     return;
     }
 
-  typedef itk::ImageFileReader<FloatVectorImageType> ReaderType;
-  ReaderType::Pointer reader = ReaderType::New();
-  reader->SetFileName(fileName.toStdString());
-  reader->Update();
-  
-  this->FixedImage = reader->GetOutput();
+  LoadFixedImage(fileName.toStdString());
+}
 
-  if(this->chkRGB->isChecked())
+void Form::LoadFixedImage(const std::string& imageFileName, const std::string& landmarksFileName)
+{
+  this->FixedLoader = StartLoader(imageFileName, landmarksFileName);
+}
+
+void Form::LoadMovingImage(const std::string& imageFileName, const std::string& landmarksFileName)
+{
+  this->MovingLoader = StartLoader(imageFileName, landmarksFileName);
+}
+
+ImageLoader* Form::StartLoader(const std::string& imageFileName, const std::string& landmarksFileName)
+{
+  ImageLoader* loader = new ImageLoader(this);
+  loader->SetImageFileName(imageFileName);
+  loader->SetLandmarksFileName(landmarksFileName);
+  loader->SetRGB(this->chkRGB->isChecked());
+
+  connect(loader, SIGNAL(PreviewReady()), this, SLOT(slot_PreviewReady()));
+  connect(loader, SIGNAL(ImageReady()), this, SLOT(slot_ImageReady()));
+  connect(loader, SIGNAL(LoadFailed()), this, SLOT(slot_LoadFailed()));
+  connect(loader, SIGNAL(finished()), loader, SLOT(deleteLater()));
+
+  this->statusbar->showMessage(QString("Loading ") + imageFileName.c_str());
+  loader->start();
+  return loader;
+}
+
+void Form::slot_PreviewReady()
+{
+  // Signals from a loader that has since been replaced by another one are ignored
+  ImageLoader* loader = qobject_cast<ImageLoader*>(this->sender());
+  if(loader == this->FixedLoader)
     {
-    Helpers::ITKImagetoVTKRGBImage(this->FixedImage, this->FixedImageData);
+    DisplayImage(loader->GetPreviewImageData(), this->FixedImageActor, this->LeftRenderer, this->qvtkWidgetLeft);
+    }
+  else if(loader == this->MovingLoader)
+    {
+    DisplayImage(loader->GetPreviewImageData(), this->MovingImageActor, this->RightRenderer, this->qvtkWidgetRight);
+    }
+}
+
+void Form::slot_ImageReady()
+{
+  ImageLoader* loader = qobject_cast<ImageLoader*>(this->sender());
+  if(loader == this->FixedLoader)
+    {
+    this->FixedImage = loader->GetImage();
+    this->FixedVolume = loader->GetVolume();
+    loader->GetMagnitudeRange(this->FixedMagnitudeRange[0], this->FixedMagnitudeRange[1]);
+    ClearRegistration();
+    this->FixedImageData = loader->GetImageData();
+    this->FixedImageActor->VisibilityOn();
+    DisplayImage(this->FixedImageData, this->FixedImageActor, this->LeftRenderer, this->qvtkWidgetLeft);
+    if(this->FixedVolume)
+      {
+      this->MemoryManager.Track("Fixed image", this->FixedVolume, ImageMemoryManager::SourceBuffer);
+      }
+    else
+      {
+      this->MemoryManager.Track("Fixed image", this->FixedImage, ImageMemoryManager::SourceBuffer);
+      }
+    this->MemoryManager.Track("Fixed display", this->FixedImageData, ImageMemoryManager::DisplayBuffer);
+    SetupSeedWidget(this->FixedSeedWidget, this->FixedSeedCallback, this->FixedSeedRepresentation, this->qvtkWidgetLeft);
+    ShowVolumeSlider(this->sldFixedSlice, this->FixedVolume);
+    this->FixedSeedCallback->SetSlice(this->sldFixedSlice->value());
+    if(loader->HasLandmarks())
+      {
+      Helpers::PlaceSeeds(this->FixedSeedWidget, loader->GetLandmarks());
+      }
+    }
+  else if(loader == this->MovingLoader)
+    {
+    this->MovingImage = loader->GetImage();
+    this->MovingVolume = loader->GetVolume();
+    loader->GetMagnitudeRange(this->MovingMagnitudeRange[0], this->MovingMagnitudeRange[1]);
+    ClearRegistration();
+    ShowFixedDisplay();
+    this->MovingImageData = loader->GetImageData();
+    DisplayImage(this->MovingImageData, this->MovingImageActor, this->RightRenderer, this->qvtkWidgetRight);
+    if(this->MovingVolume)
+      {
+      this->MemoryManager.Track("Moving image", this->MovingVolume, ImageMemoryManager::SourceBuffer);
+      }
+    else
+      {
+      this->MemoryManager.Track("Moving image", this->MovingImage, ImageMemoryManager::SourceBuffer);
+      }
+    this->MemoryManager.Track("Moving display", this->MovingImageData, ImageMemoryManager::DisplayBuffer);
+    SetupSeedWidget(this->MovingSeedWidget, this->MovingSeedCallback, this->MovingSeedRepresentation, this->qvtkWidgetRight);
+    ShowVolumeSlider(this->sldMovingSlice, this->MovingVolume);
+    this->MovingSeedCallback->SetSlice(this->sldMovingSlice->value());
+    if(loader->HasLandmarks())
+      {
+      Helpers::PlaceSeeds(this->MovingSeedWidget, loader->GetLandmarks());
+      }
     }
   else
     {
-    Helpers::ITKImagetoVTKMagnitudeImage(this->FixedImage, this->FixedImageData);
+    return;
     }
-  
-  this->FixedImageActor->SetInput(this->FixedImageData);
+
+  this->statusbar->showMessage(QString("Loaded ") + loader->GetImageFileName().c_str());
+  UpdateMemoryUsage();
+}
+
+void Form::ClearRegistration()
+{
+  this->LeftRenderer->RemoveActor(this->TransformedImageActor);
+  this->LeftRenderer->RemoveActor(this->MappedPointsActor);
+
+  this->TransformedImage = NULL;
+  this->TransformedVolume = NULL;
+  this->TransformedImageData = vtkSmartPointer<vtkImageData>::New();
+  this->DeformationField = NULL;
+  this->InverseDeformationField = NULL;
+
+  this->MemoryManager.Forget("Transformed image");
+  this->MemoryManager.Forget("Transformed volume");
+  this->MemoryManager.Forget("Transformed display");
+  this->MemoryManager.Forget("Deformation field");
+  this->MemoryManager.Forget("Inverse deformation field");
+}
+
+void Form::ShowFixedDisplay()
+{
+  if(!this->FixedImage && !this->FixedVolume)
+    {
+    return;
+    }
+
+  // It may have been evicted while the transformed image covered it
+  if(!this->MemoryManager.IsResident("Fixed display"))
+    {
+    if(this->FixedVolume)
+      {
+      Helpers::ITKVolumeSlicetoVTKImage(this->FixedVolume, this->sldFixedSlice->value(), this->chkRGB->isChecked(),
+                                        this->FixedMagnitudeRange[0], this->FixedMagnitudeRange[1], this->FixedImageData);
+      }
+    else if(this->chkRGB->isChecked())
+      {
+      Helpers::ITKImagetoVTKRGBImage(this->FixedImage, this->FixedImageData);
+      }
+    else
+      {
+      Helpers::ITKImagetoVTKMagnitudeImage(this->FixedImage, this->FixedImageData);
+      }
+    }
+  this->MemoryManager.SetPinned("Fixed display", true);
+  this->MemoryManager.Touch("Fixed display");
+
+  this->FixedImageActor->VisibilityOn();
+  this->qvtkWidgetLeft->GetRenderWindow()->Render();
+}
+
+void Form::slot_UpdateSeedColors()
+{
+  const int numberOfPairs = this->FixedSeedRepresentation->GetNumberOfSeeds();
+  for(int seedId = 0; seedId < this->MovingSeedRepresentation->GetNumberOfSeeds(); ++seedId)
+    {
+    vtkPointHandleRepresentation2D* handle =
+      vtkPointHandleRepresentation2D::SafeDownCast(this->MovingSeedRepresentation->GetHandleRepresentation(seedId));
+    if(handle)
+      {
+      handle->GetProperty()->SetColor(seedId < numberOfPairs ? 1 : 0, seedId < numberOfPairs ? 0 : 1, 0);
+      }
+    }
+  this->qvtkWidgetRight->GetRenderWindow()->Render();
+}
+
+void Form::slot_LoadFailed()
+{
+  ImageLoader* loader = qobject_cast<ImageLoader*>(this->sender());
+  if(loader != this->FixedLoader && loader != this->MovingLoader)
+    {
+    return;
+    }
+  this->statusbar->showMessage(QString("Could not load ") + loader->GetImageFileName().c_str());
+}
+
+void Form::UpdateMemoryUsage()
+{
+  this->MemoryManager.EnforceBudget();
+
+  const unsigned long long megabyte = 1024 * 1024;
+  QString usage = QString("Images: %1 MB").arg(this->MemoryManager.GetWorkingSet() / megabyte);
+  if(this->MemoryManager.GetBudget() > 0)
+    {
+    usage += QString(" of %1 MB").arg(this->MemoryManager.GetBudget() / megabyte);
+    }
+  this->MemoryLabel->setText(usage);
+}
+
+void Form::DisplayImage(vtkImageData* imageData, vtkImageActor* imageActor, vtkRenderer* renderer, QVTKWidget* qvtkWidget)
+{
+  // Only the first image shown in a renderer resets the camera, so the switch from the preview to the full
+  // resolution image doesn't move the view.
+  bool firstImage = !renderer->HasViewProp(imageActor);
+
+  imageActor->SetInput(imageData);
 
   // Add Actor to renderer
-  this->LeftRenderer->AddActor(this->FixedImageActor);
-  this->LeftRenderer->ResetCamera();
+  renderer->AddActor(imageActor);
+  if(firstImage)
+    {
+    renderer->ResetCamera();
+    }
+
+  qvtkWidget->GetRenderWindow()->Render();
+}
+
+void Form::SetupSeedWidget(vtkSmartPointer<vtkSeedWidget>& seedWidget, vtkSmartPointer<vtkSeedCallback>& seedCallback,
+                           vtkSeedRepresentation* seedRepresentation, QVTKWidget* qvtkWidget)
+{
+  // This is deferred until the first full resolution image is shown, and only done once
+  if(seedWidget)
+    {
+    return;
+    }
 
   vtkSmartPointer<vtkInteractorStyleImage> interactorStyle =
       vtkSmartPointer<vtkInteractorStyleImage>::New();
-  this->qvtkWidgetLeft->GetRenderWindow()->GetInteractor()->SetInteractorStyle(interactorStyle);
+  qvtkWidget->GetRenderWindow()->GetInteractor()->SetInteractorStyle(interactorStyle);
 
-  this->LeftRenderer->ResetCamera();
-
-  std::cout << "Fixed interactor: " << this->qvtkWidgetLeft->GetRenderWindow()->GetInteractor() << std::endl;
   // Seed widget
-  this->FixedSeedWidget = vtkSmartPointer<vtkSeedWidget>::New();
-  this->FixedSeedWidget->SetInteractor(this->qvtkWidgetLeft->GetRenderWindow()->GetInteractor());
-  this->FixedSeedWidget->SetRepresentation(this->FixedSeedRepresentation);
-  
-  this->FixedSeedCallback = vtkSmartPointer<vtkSeedCallback>::New();
-  this->FixedSeedCallback->SetWidget(this->FixedSeedWidget);
-  
-  this->FixedSeedWidget->AddObserver(vtkCommand::PlacePointEvent,this->FixedSeedCallback);
-  this->FixedSeedWidget->AddObserver(vtkCommand::InteractionEvent,this->FixedSeedCallback);
-  this->FixedSeedWidget->On();
+  seedWidget = vtkSmartPointer<vtkSeedWidget>::New();
+  seedWidget->SetInteractor(qvtkWidget->GetRenderWindow()->GetInteractor());
+  seedWidget->SetRepresentation(seedRepresentation);
+
+  seedCallback = vtkSmartPointer<vtkSeedCallback>::New();
+  seedCallback->SetWidget(seedWidget);
+
+  seedWidget->AddObserver(vtkCommand::PlacePointEvent,seedCallback);
+  seedWidget->AddObserver(vtkCommand::InteractionEvent,seedCallback);
+  seedWidget->AddObserver(vtkCommand::DeletePointEvent,seedCallback);
+  seedWidget->AddObserver(vtkSeedCallback::SeedsMovedEvent,seedCallback);
+
+  // Dragging or deleting a seed on either side makes the leave-one-out errors shown on both sides stale
+  vtkSmartPointer<vtkCallbackCommand> landmarkErrorsCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+  landmarkErrorsCallback->SetCallback(ClearLandmarkErrorsCallback);
+  landmarkErrorsCallback->SetClientData(this);
+  seedWidget->AddObserver(vtkCommand::InteractionEvent,landmarkErrorsCallback);
+  seedWidget->AddObserver(vtkCommand::DeletePointEvent,landmarkErrorsCallback);
+
+  // The moving seeds that are only mapped are colored apart from the registered pairs
+  vtkSmartPointer<vtkCallbackCommand> seedColorsCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+  seedColorsCallback->SetCallback(UpdateSeedColorsCallback);
+  seedColorsCallback->SetClientData(this);
+  seedWidget->AddObserver(vtkCommand::PlacePointEvent,seedColorsCallback);
+  seedWidget->AddObserver(vtkCommand::DeletePointEvent,seedColorsCallback);
+  seedWidget->On();
+}
+
+bool Form::ResampleTransformedImage()
+{
+  if(!this->DeformationField || !this->FixedImage || !this->MovingImage)
+    {
+    std::cerr << "The transformed image can not be resampled without the field of its registration!" << std::endl;
+    return false;
+    }
+
+  // The float field serves both the float and the mixed precision policies, which warp alike
+  FloatVectorImageType::Pointer transformedImage =
+    WarpThroughField<DoublePrecision>(this->DeformationField, this->MovingImage, this->FixedImage);
+  if(!transformedImage)
+    {
+    transformedImage = WarpThroughField<FloatPrecision>(this->DeformationField, this->MovingImage, this->FixedImage);
+    }
+  if(!transformedImage)
+    {
+    std::cerr << "Unknown deformation field type!" << std::endl;
+    return false;
+    }
+
+  this->TransformedImage = transformedImage;
+  this->MemoryManager.Track("Transformed image", this->TransformedImage, ImageMemoryManager::IntermediateBuffer);
+  this->MemoryManager.SetPinned("Transformed image", false);
+  return true;
 }
 
 void Form::on_actionSave_activated()
 {
-  if(this->chkRGB->isChecked())
+  if(this->TransformedVolume)
     {
-    QString fileName = QFileDialog::getSaveFileName(this, "Save File", ".", "Image Files (*.png)");
+    QString fileName = QFileDialog::getSaveFileName(this, "Save File", ".", "Image Files (*.mhd)");
     std::cout << "Got filename: " << fileName.toStdString() << std::endl;
     if(fileName.toStdString().empty())
       {
       std::cout << "Filename was empty." << std::endl;
       return;
       }
+
+    // The volume may have been evicted to stay within the memory budget. It is registered again if so, and
+    // stays pinned until it is written.
+    if(this->MemoryManager.IsResident("Transformed volume"))
+      {
+      this->MemoryManager.SetPinned("Transformed volume", true);
+      }
+    else
+      {
+      RegisterVolumes(true);
+      }
+    typedef  itk::ImageFileWriter< FloatVectorVolumeType  > WriterType;
+    WriterType::Pointer writer = WriterType::New();
+    writer->SetFileName(fileName.toStdString());
+    writer->SetInput(this->TransformedVolume);
+    writer->Update();
+
+    this->MemoryManager.SetPinned("Transformed volume", false);
+    UpdateMemoryUsage();
+    return;
+    }
+
+  if(!this->TransformedImage)
+    {
+    std::cerr << "There is no transformed image to save!" << std::endl;
+    return;
+    }
+
+  QString fileName = QFileDialog::getSaveFileName(this, "Save File", ".",
+                                                  this->chkRGB->isChecked() ? "Image Files (*.png)" : "Image Files (*.mhd)");
+  std::cout << "Got filename: " << fileName.toStdString() << std::endl;
+  if(fileName.toStdString().empty())
+    {
+    std::cout << "Filename was empty." << std::endl;
+    return;
+    }
+
+  // The transformed image may have been evicted to stay within the memory budget. It is resampled again from
+  // the field, and stays pinned until it is written.
+  if(!this->MemoryManager.IsResident("Transformed image") && !ResampleTransformedImage())
+    {
+    return;
+    }
+  this->MemoryManager.SetPinned("Transformed image", true);
+
+  if(this->chkRGB->isChecked())
+    {
     typedef itk::CastImageFilter< FloatVectorImageType, UnsignedCharVectorImageType > CastFilterType;
     CastFilterType::Pointer castFilter = CastFilterType::New();
     castFilter->SetInput(this->TransformedImage);
@@ -328,13 +975,6 @@ void Form::on_actionSave_activated()
     }
   else
     {
-    QString fileName = QFileDialog::getSaveFileName(this, "Save File", ".", "Image Files (*.mhd)");
-    std::cout << "Got filename: " << fileName.toStdString() << std::endl;
-    if(fileName.toStdString().empty())
-      {
-      std::cout << "Filename was empty." << std::endl;
-      return;
-      }
     typedef  itk::ImageFileWriter< FloatVectorImageType  > WriterType;
     WriterType::Pointer writer = WriterType::New();
     writer->SetFileName(fileName.toStdString());
@@ -342,4 +982,6 @@ void Form::on_actionSave_activated()
     writer->Update();
     }
 
+  this->MemoryManager.SetPinned("Transformed image", false);
+  UpdateMemoryUsage();
 }
@@ -31,9 +31,12 @@
 
 // Qt
 #include <QMainWindow>
+#include <QPointer>
 
 // Custom
 #include "Types.h"
+#include "ImageLoader.h"
+#include "ImageMemoryManager.h"
 #include "SeedCallback.h"
 
 // Forward declarations
@@ -43,6 +46,8 @@ class BorderCallbackClass;
 class vtkImageData;
 class vtkImageActor;
 class vtkActor;
+class vtkVertexGlyphFilter;
+class QLabel;
 
 class Form : public QMainWindow, public Ui::Form
 {
@@ -51,33 +56,96 @@ public:
 
   // Constructor/Destructor
   Form();
-  ~Form() {};
+  ~Form();
+
+  // Start loading the images (and optionally their landmarks) in the background
+  void LoadFixedImage(const std::string& imageFileName, const std::string& landmarksFileName = "");
+  void LoadMovingImage(const std::string& imageFileName, const std::string& landmarksFileName = "");
+
+  // Remove the leave-one-out errors from the seed labels, e.g. once a seed was moved
+  void ClearLandmarkErrors();
 
 public slots:
   void on_actionOpenMovingImage_activated();
   void on_actionOpenFixedImage_activated();
   void on_actionSave_activated();
   void on_btnRegister_clicked();
+  void on_btnMapSeeds_clicked();
+  void on_sldFixedSlice_valueChanged(int slice);
+  void on_sldMovingSlice_valueChanged(int slice);
+
+  void slot_PreviewReady();
+  void slot_ImageReady();
+  void slot_LoadFailed();
+
+  // Moving seeds that pair with a fixed seed are red, the ones after them (which are only mapped) are green
+  void slot_UpdateSeedColors();
 
 protected:
 
+  // If 'keepPinned' is set, the transformed volume stays pinned for the caller (e.g. to save it)
+  void RegisterVolumes(const bool keepPinned = false);
+
+  // Drop the transformed image or volume and the fields of the last registration, which no longer apply once either
+  // image is replaced
+  void ClearRegistration();
+
+  // Show the fixed image again in the left view, converting it for display if it was evicted
+  void ShowFixedDisplay();
+
+  // Resample the transformed image from the field of the last 2D registration, e.g. after it was evicted. The
+  // landmarks are not refined again. Returns false if there is no field.
+  bool ResampleTransformedImage();
+
+  // Label each seed with the leave-one-out error of its landmark pair, in moving image pixels
+  void ShowLandmarkErrors(const std::vector<double>& errors, const unsigned int dimension);
+
+  void ShowVolumeSlider(QSlider* slider, FloatVectorVolumeType* volume);
+
+  ImageLoader* StartLoader(const std::string& imageFileName, const std::string& landmarksFileName);
+  void DisplayImage(vtkImageData* imageData, vtkImageActor* imageActor, vtkRenderer* renderer, QVTKWidget* qvtkWidget);
+  void SetupSeedWidget(vtkSmartPointer<vtkSeedWidget>& seedWidget, vtkSmartPointer<vtkSeedCallback>& seedCallback,
+                       vtkSeedRepresentation* seedRepresentation, QVTKWidget* qvtkWidget);
+
+  // The loaders currently running, if any
+  QPointer<ImageLoader> FixedLoader;
+  QPointer<ImageLoader> MovingLoader;
+
+  // Evict what can be regenerated if the images are over budget, and show the working set in the status bar
+  void UpdateMemoryUsage();
+  ImageMemoryManager MemoryManager;
+  QLabel* MemoryLabel;
+
   vtkSmartPointer<vtkRenderer> LeftRenderer;
   vtkSmartPointer<vtkRenderer> RightRenderer;
   
-  // Fixed image
+  // Fixed image. Either FixedImage or FixedVolume is set, depending on the file.
   FloatVectorImageType::Pointer FixedImage;
+  FloatVectorVolumeType::Pointer FixedVolume;
+  float FixedMagnitudeRange[2];
   vtkSmartPointer<vtkImageActor> FixedImageActor;
   vtkSmartPointer<vtkImageData> FixedImageData;
   
   // Moving image
   FloatVectorImageType::Pointer MovingImage;
+  FloatVectorVolumeType::Pointer MovingVolume;
+  float MovingMagnitudeRange[2];
   vtkSmartPointer<vtkImageActor> MovingImageActor;
   vtkSmartPointer<vtkImageData> MovingImageData;
   
   // Transformed image
   FloatVectorImageType::Pointer TransformedImage;
+  FloatVectorVolumeType::Pointer TransformedVolume;
   vtkSmartPointer<vtkImageActor> TransformedImageActor;
   vtkSmartPointer<vtkImageData> TransformedImageData;  
+
+  // The field of the last 2D registration (of the precision that was chosen), and its inverse once it is needed
+  itk::DataObject::Pointer DeformationField;
+  itk::DataObject::Pointer InverseDeformationField;
+
+  // Moving seeds mapped to the fixed image. They are not fixed seeds, so they are not registered.
+  vtkSmartPointer<vtkVertexGlyphFilter> MappedPointsGlyphFilter;
+  vtkSmartPointer<vtkActor> MappedPointsActor;
   
   vtkSmartPointer<vtkSeedWidget> FixedSeedWidget;
   vtkSmartPointer<vtkSeedWidget> MovingSeedWidget;
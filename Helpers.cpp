@@ -17,10 +17,21 @@
  *=========================================================================*/
 
 #include "Helpers.h"
+#include "SeedCallback.h"
 
 #include "itkImageRegionIterator.h"
-#include "itkVectorMagnitudeImageFilter.h"
-#include "itkRescaleIntensityImageFilter.h"
+#include "itkNumericTraits.h"
+
+#include <vtkCommand.h>
+#include <vtkHandleRepresentation.h>
+#include <vtkHandleWidget.h>
+#include <vtkSeedRepresentation.h>
+#include <vtkSeedWidget.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
 
 namespace Helpers
 {
@@ -82,24 +93,16 @@ void ITKImagetoVTKRGBImage(FloatVectorImageType::Pointer image, vtkImageData* ou
 void ITKImagetoVTKMagnitudeImage(FloatVectorImageType::Pointer image, vtkImageData* outputImage)
 {
   std::cout << "ITKImagetoVTKMagnitudeImage()" << std::endl;
-  // Compute the magnitude of the ITK image
-  typedef itk::VectorMagnitudeImageFilter<
-                  FloatVectorImageType, FloatScalarImageType >  VectorMagnitudeFilterType;
-
-  // Create and setup a magnitude filter
-  VectorMagnitudeFilterType::Pointer magnitudeFilter = VectorMagnitudeFilterType::New();
-  magnitudeFilter->SetInput( image );
-  magnitudeFilter->Update();
 
-  // Rescale and cast for display
-  typedef itk::RescaleIntensityImageFilter<
-                  FloatScalarImageType, UnsignedCharScalarImageType > RescaleFilterType;
+  // The magnitudes are computed twice (once for the range, once for the output) rather than stored, so no
+  // image sized intermediate buffers are needed.
+  const unsigned int components = image->GetNumberOfComponentsPerPixel();
+  const unsigned long numberOfPixels = image->GetLargestPossibleRegion().GetNumberOfPixels();
+  const float* buffer = image->GetBufferPointer();
 
-  RescaleFilterType::Pointer rescaleFilter = RescaleFilterType::New();
-  rescaleFilter->SetOutputMinimum(0);
-  rescaleFilter->SetOutputMaximum(255);
-  rescaleFilter->SetInput( magnitudeFilter->GetOutput() );
-  rescaleFilter->Update();
+  float minimum;
+  float maximum;
+  ComputeMagnitudeRange(image.GetPointer(), minimum, maximum);
 
   // Setup and allocate the VTK image
   outputImage->SetNumberOfScalarComponents(1);
@@ -110,17 +113,183 @@ void ITKImagetoVTKMagnitudeImage(FloatVectorImageType::Pointer image, vtkImageDa
 
   outputImage->AllocateScalars();
 
-  // Copy all of the scaled magnitudes to the output image
-  itk::ImageRegionConstIteratorWithIndex<UnsignedCharScalarImageType> imageIterator(rescaleFilter->GetOutput(), rescaleFilter->GetOutput()->GetLargestPossibleRegion());
-  imageIterator.GoToBegin();
+  // Rescale the magnitudes to the display range. Both images store x fastest, so the pixels line up.
+  unsigned char* output = static_cast<unsigned char*>(outputImage->GetScalarPointer());
+  const float scale = (maximum > minimum) ? 255.0f / (maximum - minimum) : 0.0f;
+  for(unsigned long pixelId = 0; pixelId < numberOfPixels; pixelId++)
+    {
+    output[pixelId] = static_cast<unsigned char>((PixelMagnitude(buffer + pixelId * components, components) - minimum) * scale);
+    }
+}
 
-  while(!imageIterator.IsAtEnd())
+void ITKImagetoVTKPreviewImage(FloatVectorImageType::Pointer image, const unsigned int maxSize, const bool rgb, vtkImageData* outputImage)
+{
+  const unsigned int width = image->GetLargestPossibleRegion().GetSize()[0];
+  const unsigned int height = image->GetLargestPossibleRegion().GetSize()[1];
+  const unsigned int factor = std::max(1u, (std::max(width, height) + maxSize - 1) / maxSize);
+  const unsigned int components = image->GetNumberOfComponentsPerPixel();
+  if(rgb && components < 3)
     {
-    unsigned char* pixel = static_cast<unsigned char*>(outputImage->GetScalarPointer(imageIterator.GetIndex()[0],
-                                                                                     imageIterator.GetIndex()[1],0));
-    pixel[0] = imageIterator.Get();
+    std::cerr << "The input image has " << components << " components, but at least 3 are required." << std::endl;
+    return;
+    }
 
-    ++imageIterator;
+  outputImage->SetNumberOfScalarComponents(rgb ? 3 : 1);
+  outputImage->SetScalarTypeToUnsignedChar();
+  outputImage->SetDimensions((width + factor - 1) / factor, (height + factor - 1) / factor, 1);
+  outputImage->SetSpacing(factor, factor, 1);
+  outputImage->AllocateScalars();
+
+  const float* buffer = image->GetBufferPointer();
+  unsigned char* output = static_cast<unsigned char*>(outputImage->GetScalarPointer());
+
+  if(rgb)
+    {
+    for(unsigned int y = 0; y < height; y += factor)
+      {
+      for(unsigned int x = 0; x < width; x += factor)
+        {
+        const float* pixel = buffer + (y * width + x) * components;
+        for(unsigned int component = 0; component < 3; component++)
+          {
+          *output++ = static_cast<unsigned char>(pixel[component]);
+          }
+        }
+      }
+    return;
+    }
+
+  // Rescale the magnitudes of the sampled pixels to the full display range
+  std::vector<float> magnitudes;
+  magnitudes.reserve(((width + factor - 1) / factor) * ((height + factor - 1) / factor));
+  for(unsigned int y = 0; y < height; y += factor)
+    {
+    for(unsigned int x = 0; x < width; x += factor)
+      {
+      magnitudes.push_back(PixelMagnitude(buffer + (y * width + x) * components, components));
+      }
+    }
+
+  const float minimum = *std::min_element(magnitudes.begin(), magnitudes.end());
+  const float maximum = *std::max_element(magnitudes.begin(), magnitudes.end());
+  const float scale = (maximum > minimum) ? 255.0f / (maximum - minimum) : 0.0f;
+  for(unsigned int i = 0; i < magnitudes.size(); i++)
+    {
+    output[i] = static_cast<unsigned char>((magnitudes[i] - minimum) * scale);
+    }
+}
+
+std::vector<ContinuousIndexType> GetSeedIndices(vtkSeedRepresentation* seedRepresentation)
+{
+  std::vector<ContinuousIndexType> indices(seedRepresentation->GetNumberOfSeeds());
+  for(unsigned int seedId = 0; seedId < indices.size(); seedId++)
+    {
+    double pos[3];
+    seedRepresentation->GetSeedWorldPosition(seedId, pos);
+    indices[seedId][0] = pos[0];
+    indices[seedId][1] = pos[1];
+    }
+  return indices;
+}
+
+void SetSeedIndices(vtkSeedWidget* seedWidget, const std::vector<ContinuousIndexType>& indices)
+{
+  vtkSeedRepresentation* seedRepresentation = vtkSeedRepresentation::SafeDownCast(seedWidget->GetRepresentation());
+  for(unsigned int seedId = 0; seedId < indices.size(); seedId++)
+    {
+    double pos[3];
+    seedRepresentation->GetSeedWorldPosition(seedId, pos);
+    pos[0] = indices[seedId][0];
+    pos[1] = indices[seedId][1];
+    seedRepresentation->GetHandleRepresentation(seedId)->SetWorldPosition(pos);
+    }
+
+  // Let the observers (e.g. the seed labels) know that the seeds moved. This is not an InteractionEvent, which
+  // would be taken for the user dragging the seed under the mouse.
+  seedWidget->InvokeEvent(vtkSeedCallback::SeedsMovedEvent, NULL);
+}
+
+void PlaceSeeds(vtkSeedWidget* seedWidget, const std::vector<ContinuousIndexType>& indices)
+{
+  for(unsigned int i = 0; i < indices.size(); i++)
+    {
+    double pos[3] = {indices[i][0], indices[i][1], 0};
+    vtkHandleWidget* handle = seedWidget->CreateNewHandle();
+    handle->GetHandleRepresentation()->SetWorldPosition(pos);
+    handle->EnabledOn();
+
+    // Let the observers (e.g. the seed labels) know about the new seed
+    seedWidget->InvokeEvent(vtkCommand::PlacePointEvent, NULL);
+    }
+}
+
+std::vector<ContinuousIndexType> ReadLandmarks(const std::string& fileName)
+{
+  std::vector<ContinuousIndexType> landmarks;
+
+  std::ifstream fin(fileName.c_str());
+  if(!fin)
+    {
+    std::cerr << "Could not open landmark file " << fileName << std::endl;
+    return landmarks;
+    }
+
+  std::string line;
+  while(std::getline(fin, line))
+    {
+    std::stringstream ss(line);
+    ContinuousIndexType landmark;
+    if(ss >> landmark[0] >> landmark[1])
+      {
+      landmarks.push_back(landmark);
+      }
+    }
+
+  return landmarks;
+}
+
+void ITKVolumeSlicetoVTKImage(FloatVectorVolumeType::Pointer volume, const unsigned int slice, const bool rgb,
+                              const float minimum, const float maximum, vtkImageData* outputImage)
+{
+  const FloatVectorVolumeType::SizeType size = volume->GetLargestPossibleRegion().GetSize();
+  const unsigned int components = volume->GetNumberOfComponentsPerPixel();
+  if(slice >= size[2])
+    {
+    std::cerr << "Slice " << slice << " is outside of the volume, which has " << size[2] << " slices." << std::endl;
+    return;
+    }
+  if(rgb && components < 3)
+    {
+    std::cerr << "The input image has " << components << " components, but at least 3 are required." << std::endl;
+    return;
+    }
+
+  outputImage->SetNumberOfScalarComponents(rgb ? 3 : 1);
+  outputImage->SetScalarTypeToUnsignedChar();
+  outputImage->SetDimensions(size[0], size[1], 1);
+  outputImage->AllocateScalars();
+
+  // Slices are contiguous in the buffer
+  const unsigned long slicePixels = size[0] * size[1];
+  const float* buffer = volume->GetBufferPointer() + slice * slicePixels * components;
+  unsigned char* output = static_cast<unsigned char*>(outputImage->GetScalarPointer());
+
+  if(rgb)
+    {
+    for(unsigned long pixelId = 0; pixelId < slicePixels; pixelId++)
+      {
+      for(unsigned int component = 0; component < 3; component++)
+        {
+        output[pixelId * 3 + component] = static_cast<unsigned char>(buffer[pixelId * components + component]);
+        }
+      }
+    return;
+    }
+
+  const float scale = (maximum > minimum) ? 255.0f / (maximum - minimum) : 0.0f;
+  for(unsigned long pixelId = 0; pixelId < slicePixels; pixelId++)
+    {
+    output[pixelId] = static_cast<unsigned char>((PixelMagnitude(buffer + pixelId * components, components) - minimum) * scale);
     }
 }
 
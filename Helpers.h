@@ -24,11 +24,21 @@
 #include "itkIndex.h"
 #include "itkImageRegionConstIterator.h"
 #include "itkImageRegionIterator.h"
+#include "itkNumericTraits.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
 
 // VTK
 #include <vtkSmartPointer.h>
 #include <vtkImageData.h>
 
+class vtkSeedRepresentation;
+class vtkSeedWidget;
+
 // Custom
 #include "Types.h"
 
@@ -39,6 +49,52 @@ void ITKImagetoVTKImage(FloatVectorImageType::Pointer image, vtkImageData* outpu
 void ITKImagetoVTKRGBImage(FloatVectorImageType::Pointer image, vtkImageData* outputImage);
 void ITKImagetoVTKMagnitudeImage(FloatVectorImageType::Pointer image, vtkImageData* outputImage);
 
+// Quick display image subsampled so that neither side exceeds maxSize. The spacing is set to the subsampling factor so
+// that world coordinates still match the full resolution image.
+void ITKImagetoVTKPreviewImage(FloatVectorImageType::Pointer image, const unsigned int maxSize, const bool rgb, vtkImageData* outputImage);
+
+// The images are displayed with unit spacing at the origin, so the world positions of the seeds are pixel indices.
+std::vector<ContinuousIndexType> GetSeedIndices(vtkSeedRepresentation* seedRepresentation);
+void SetSeedIndices(vtkSeedWidget* seedWidget, const std::vector<ContinuousIndexType>& indices);
+
+// Add a seed at each of the indices, as if the user had clicked there
+void PlaceSeeds(vtkSeedWidget* seedWidget, const std::vector<ContinuousIndexType>& indices);
+
+// Landmark files have one "x y" pixel position per line
+std::vector<ContinuousIndexType> ReadLandmarks(const std::string& fileName);
+
+// Convert only one slice of a volume for display. The magnitudes are rescaled from [minimum, maximum]
+// (see ComputeMagnitudeRange) rather than from the range of the slice, so the contrast is the same on every slice.
+void ITKVolumeSlicetoVTKImage(FloatVectorVolumeType::Pointer volume, const unsigned int slice, const bool rgb,
+                              const float minimum, const float maximum, vtkImageData* outputImage);
+
+inline float PixelMagnitude(const float* pixel, const unsigned int components)
+{
+  float sumOfSquares = 0;
+  for(unsigned int component = 0; component < components; component++)
+    {
+    sumOfSquares += pixel[component] * pixel[component];
+    }
+  return std::sqrt(sumOfSquares);
+}
+
+template<typename TImage>
+void ComputeMagnitudeRange(const TImage* image, float& minimum, float& maximum)
+{
+  const unsigned int components = image->GetNumberOfComponentsPerPixel();
+  const unsigned long numberOfPixels = image->GetLargestPossibleRegion().GetNumberOfPixels();
+  const float* buffer = image->GetBufferPointer();
+
+  minimum = itk::NumericTraits<float>::max();
+  maximum = itk::NumericTraits<float>::NonpositiveMin();
+  for(unsigned long pixelId = 0; pixelId < numberOfPixels; pixelId++)
+    {
+    const float magnitude = PixelMagnitude(buffer + pixelId * components, components);
+    minimum = std::min(minimum, magnitude);
+    maximum = std::max(maximum, magnitude);
+    }
+}
+
 template<typename TImage>
 void DeepCopyScalarImage(typename TImage::Pointer input, typename TImage::Pointer output)
 {
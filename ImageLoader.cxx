@@ -0,0 +1,263 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "ImageLoader.h"
+
+// STL
+#include <algorithm>
+#include <iostream>
+
+// ITK
+#include "itkImageFileReader.h"
+#include "itkImageIOFactory.h"
+
+// Qt
+#include <QMutex>
+#include <QMutexLocker>
+
+// VTK
+#include <vtkImageData.h>
+
+// Custom
+#include "Helpers.h"
+
+// The preview is shrunk until neither side exceeds this many pixels
+static const unsigned int PreviewSize = 512;
+
+ImageLoader::ImageLoader(QObject* parent) : QThread(parent), RGB(false), MagnitudeMinimum(0), MagnitudeMaximum(0)
+{
+
+}
+
+void ImageLoader::SetImageFileName(const std::string& fileName)
+{
+  this->ImageFileName = fileName;
+}
+
+void ImageLoader::SetLandmarksFileName(const std::string& fileName)
+{
+  this->LandmarksFileName = fileName;
+}
+
+void ImageLoader::SetRGB(const bool rgb)
+{
+  this->RGB = rgb;
+}
+
+std::string ImageLoader::GetImageFileName() const
+{
+  return this->ImageFileName;
+}
+
+vtkImageData* ImageLoader::GetPreviewImageData()
+{
+  return this->PreviewImageData;
+}
+
+bool ImageLoader::IsVolume() const
+{
+  return this->Volume.IsNotNull();
+}
+
+FloatVectorImageType::Pointer ImageLoader::GetImage()
+{
+  return this->Image;
+}
+
+FloatVectorVolumeType::Pointer ImageLoader::GetVolume()
+{
+  return this->Volume;
+}
+
+void ImageLoader::GetMagnitudeRange(float& minimum, float& maximum) const
+{
+  minimum = this->MagnitudeMinimum;
+  maximum = this->MagnitudeMaximum;
+}
+
+vtkImageData* ImageLoader::GetImageData()
+{
+  return this->ImageData;
+}
+
+bool ImageLoader::HasLandmarks() const
+{
+  return !this->LandmarksFileName.empty();
+}
+
+const std::vector<ContinuousIndexType>& ImageLoader::GetLandmarks() const
+{
+  return this->Landmarks;
+}
+
+void ImageLoader::run()
+{
+  // The ImageIO factories are registered the first time a reader is used. Doing it here keeps the scan off
+  // the GUI thread, and the lock keeps concurrent loaders from racing on it.
+  {
+  static QMutex factoryMutex;
+  QMutexLocker factoryLocker(&factoryMutex);
+  itk::ImageIOFactory::RegisterBuiltInFactories();
+  }
+
+  if(!this->LandmarksFileName.empty())
+    {
+    this->Landmarks = Helpers::ReadLandmarks(this->LandmarksFileName);
+    }
+
+  itk::ImageIOBase::Pointer imageIO = itk::ImageIOFactory::CreateImageIO(this->ImageFileName.c_str(),
+                                                                         itk::ImageIOFactory::ReadMode);
+  if(!imageIO)
+    {
+    std::cerr << "Could not find a reader for " << this->ImageFileName << std::endl;
+    emit LoadFailed();
+    return;
+    }
+
+  try
+    {
+    imageIO->SetFileName(this->ImageFileName);
+    imageIO->ReadImageInformation();
+    if(imageIO->GetNumberOfDimensions() >= 3 && imageIO->GetDimensions(2) > 1)
+      {
+      ReadVolume();
+      }
+    else
+      {
+      ReadImage(imageIO);
+      }
+    }
+  catch(itk::ExceptionObject& error)
+    {
+    std::cerr << "Could not read " << this->ImageFileName << ": " << error << std::endl;
+    emit LoadFailed();
+    }
+}
+
+FloatVectorImageType::Pointer ImageLoader::ReadSubsampledImage(itk::ImageIOBase* imageIO, unsigned int& factor)
+{
+  const unsigned int width = imageIO->GetDimensions(0);
+  const unsigned int height = imageIO->GetDimensions(1);
+  factor = std::max(1u, (std::max(width, height) + PreviewSize - 1) / PreviewSize);
+  if(factor == 1 || !imageIO->CanStreamRead())
+    {
+    return NULL;
+    }
+
+  FloatVectorImageType::RegionType subsampledRegion;
+  subsampledRegion.SetSize(0, (width + factor - 1) / factor);
+  subsampledRegion.SetSize(1, (height + factor - 1) / factor);
+  FloatVectorImageType::Pointer subsampledImage = FloatVectorImageType::New();
+  subsampledImage->SetRegions(subsampledRegion);
+  subsampledImage->SetNumberOfComponentsPerPixel(imageIO->GetNumberOfComponents());
+  subsampledImage->Allocate();
+
+  // Only the rows that are kept are read
+  typedef itk::ImageFileReader<FloatVectorImageType> ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(this->ImageFileName);
+  reader->SetUseStreaming(true);
+  reader->UpdateOutputInformation();
+
+  const unsigned int components = subsampledImage->GetNumberOfComponentsPerPixel();
+  float* output = subsampledImage->GetBufferPointer();
+  for(unsigned int y = 0; y < height; y += factor)
+    {
+    FloatVectorImageType::RegionType rowRegion;
+    rowRegion.SetIndex(1, y);
+    rowRegion.SetSize(0, width);
+    rowRegion.SetSize(1, 1);
+    reader->GetOutput()->SetRequestedRegion(rowRegion);
+    reader->GetOutput()->Update();
+
+    // The reader may have read more than the row, so the row is found through its buffered region
+    FloatVectorImageType::IndexType rowStart = rowRegion.GetIndex();
+    const float* row = reader->GetOutput()->GetBufferPointer() +
+                       reader->GetOutput()->ComputeOffset(rowStart) * components;
+    for(unsigned int x = 0; x < width; x += factor)
+      {
+      std::copy(row + x * components, row + (x + 1) * components, output);
+      output += components;
+      }
+    }
+
+  return subsampledImage;
+}
+
+void ImageLoader::ReadImage(itk::ImageIOBase* imageIO)
+{
+  // Formats that can stream show a preview read from every few rows and columns before the full read. The others
+  // show one made from the full image, which still comes before the full resolution display conversion.
+  unsigned int factor = 1;
+  FloatVectorImageType::Pointer subsampledImage = ReadSubsampledImage(imageIO, factor);
+  if(subsampledImage)
+    {
+    this->PreviewImageData = vtkSmartPointer<vtkImageData>::New();
+    Helpers::ITKImagetoVTKPreviewImage(subsampledImage, PreviewSize, this->RGB, this->PreviewImageData);
+    this->PreviewImageData->SetSpacing(factor, factor, 1);
+    emit PreviewReady();
+    }
+
+  typedef itk::ImageFileReader<FloatVectorImageType> ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(this->ImageFileName);
+  reader->Update();
+
+  this->Image = reader->GetOutput();
+  this->Image->DisconnectPipeline();
+
+  if(!subsampledImage)
+    {
+    this->PreviewImageData = vtkSmartPointer<vtkImageData>::New();
+    Helpers::ITKImagetoVTKPreviewImage(this->Image, PreviewSize, this->RGB, this->PreviewImageData);
+    emit PreviewReady();
+    }
+
+  this->ImageData = vtkSmartPointer<vtkImageData>::New();
+  if(this->RGB)
+    {
+    Helpers::ITKImagetoVTKRGBImage(this->Image, this->ImageData);
+    }
+  else
+    {
+    Helpers::ITKImagetoVTKMagnitudeImage(this->Image, this->ImageData);
+    }
+  emit ImageReady();
+}
+
+void ImageLoader::ReadVolume()
+{
+  typedef itk::ImageFileReader<FloatVectorVolumeType> ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(this->ImageFileName);
+  reader->Update();
+
+  this->Volume = reader->GetOutput();
+  this->Volume->DisconnectPipeline();
+
+  // The display range is computed once for the whole volume so that slices can be converted on demand later
+  Helpers::ComputeMagnitudeRange(this->Volume.GetPointer(), this->MagnitudeMinimum, this->MagnitudeMaximum);
+
+  // A single slice is cheap enough that there is no separate preview
+  this->ImageData = vtkSmartPointer<vtkImageData>::New();
+  Helpers::ITKVolumeSlicetoVTKImage(this->Volume, this->Volume->GetLargestPossibleRegion().GetSize()[2] / 2, this->RGB,
+                                    this->MagnitudeMinimum, this->MagnitudeMaximum, this->ImageData);
+  this->PreviewImageData = this->ImageData;
+  emit PreviewReady();
+  emit ImageReady();
+}
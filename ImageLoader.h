@@ -0,0 +1,98 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+// STL
+#include <string>
+#include <vector>
+
+// Qt
+#include <QThread>
+
+// ITK
+#include "itkImageIOBase.h"
+
+// VTK
+#include <vtkSmartPointer.h>
+
+// Custom
+#include "Types.h"
+
+class vtkImageData;
+
+// Reads an image (and optionally a landmark file) on a background thread and prepares it for display.
+// PreviewReady is emitted once a downsampled display image is available. For file formats that can stream (e.g.
+// .mhd) it is read from a subset of the rows before the full read, for the others it is made from the full image.
+// ImageReady is emitted once the full resolution image and display image are available. The results must only be accessed after the matching signal.
+// Files with more than one slice are read as volumes. Only their middle slice is converted for display.
+class ImageLoader : public QThread
+{
+  Q_OBJECT
+public:
+  ImageLoader(QObject* parent = 0);
+
+  // These must be set before start()
+  void SetImageFileName(const std::string& fileName);
+  void SetLandmarksFileName(const std::string& fileName);
+  void SetRGB(const bool rgb);
+
+  std::string GetImageFileName() const;
+
+  // Available after PreviewReady
+  vtkImageData* GetPreviewImageData();
+
+  // Available after ImageReady. Exactly one of GetImage() and GetVolume() is set.
+  bool IsVolume() const;
+  FloatVectorImageType::Pointer GetImage();
+  FloatVectorVolumeType::Pointer GetVolume();
+  void GetMagnitudeRange(float& minimum, float& maximum) const;
+  vtkImageData* GetImageData();
+  bool HasLandmarks() const;
+  const std::vector<ContinuousIndexType>& GetLandmarks() const;
+
+signals:
+  void PreviewReady();
+  void ImageReady();
+  void LoadFailed();
+
+protected:
+  void run();
+
+private:
+  void ReadImage(itk::ImageIOBase* imageIO);
+  // Every 'factor'-th row and column, with 'factor' chosen for the preview size. NULL if the file format can't
+  // stream, or the image is no larger than a preview.
+  FloatVectorImageType::Pointer ReadSubsampledImage(itk::ImageIOBase* imageIO, unsigned int& factor);
+  void ReadVolume();
+
+  std::string ImageFileName;
+  std::string LandmarksFileName;
+  bool RGB;
+
+  FloatVectorImageType::Pointer Image;
+  FloatVectorVolumeType::Pointer Volume;
+  float MagnitudeMinimum;
+  float MagnitudeMaximum;
+  vtkSmartPointer<vtkImageData> PreviewImageData;
+  vtkSmartPointer<vtkImageData> ImageData;
+  std::vector<ContinuousIndexType> Landmarks;
+};
+
+#endif
@@ -0,0 +1,258 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "ImageMemoryManager.h"
+
+// STL
+#include <iostream>
+
+// ITK
+#include "itksys/SystemInformation.hxx"
+
+// VTK
+#include <vtkImageData.h>
+
+// Custom
+#include "PrecisionPolicy.h"
+
+// The size of the pixel buffer if 'image' is a TImage, otherwise zero
+template <typename TImage>
+static unsigned long long ImageSize(const itk::DataObject* image)
+{
+  const TImage* typedImage = dynamic_cast<const TImage*>(image);
+  if(!typedImage)
+    {
+    return 0;
+    }
+  return static_cast<unsigned long long>(typedImage->GetPixelContainer()->Size()) * sizeof(typename TImage::InternalPixelType);
+}
+
+ImageMemoryManager::ImageMemoryManager() : Clock(0)
+{
+  itksys::SystemInformation systemInformation;
+  systemInformation.RunMemoryCheck();
+  this->Budget = static_cast<unsigned long long>(systemInformation.GetTotalPhysicalMemory()) * 1024 * 1024 / 2;
+}
+
+void ImageMemoryManager::SetBudget(const unsigned long long bytes)
+{
+  this->Budget = bytes;
+}
+
+unsigned long long ImageMemoryManager::GetBudget() const
+{
+  return this->Budget;
+}
+
+void ImageMemoryManager::Track(const std::string& name, FloatVectorImageType* image, const BufferType type)
+{
+  Add(name, image, NULL, type);
+}
+
+void ImageMemoryManager::Track(const std::string& name, FloatVectorVolumeType* volume, const BufferType type)
+{
+  Add(name, volume, NULL, type);
+}
+
+void ImageMemoryManager::Track(const std::string& name, vtkImageData* imageData, const BufferType type)
+{
+  Add(name, NULL, imageData, type);
+}
+
+void ImageMemoryManager::Track(const std::string& name, itk::DataObject* deformationField, const BufferType type)
+{
+  Add(name, deformationField, NULL, type);
+}
+
+void ImageMemoryManager::Add(const std::string& name, itk::DataObject* image, vtkImageData* imageData, const BufferType type)
+{
+  Entry entry;
+  entry.Image = image;
+  entry.ImageData = imageData;
+  entry.Type = type;
+  entry.Pinned = true;
+
+  this->Mutex.Lock();
+  entry.LastUse = this->Clock++;
+  this->Entries[name] = entry;
+  this->Mutex.Unlock();
+}
+
+void ImageMemoryManager::Forget(const std::string& name)
+{
+  this->Mutex.Lock();
+  this->Entries.erase(name);
+  this->Mutex.Unlock();
+}
+
+void ImageMemoryManager::SetPinned(const std::string& name, const bool pinned)
+{
+  this->Mutex.Lock();
+  EntryMapType::iterator iterator = this->Entries.find(name);
+  if(iterator != this->Entries.end())
+    {
+    iterator->second.Pinned = pinned;
+    }
+  this->Mutex.Unlock();
+}
+
+void ImageMemoryManager::Touch(const std::string& name)
+{
+  this->Mutex.Lock();
+  EntryMapType::iterator iterator = this->Entries.find(name);
+  if(iterator != this->Entries.end())
+    {
+    iterator->second.LastUse = this->Clock++;
+    }
+  this->Mutex.Unlock();
+}
+
+bool ImageMemoryManager::IsResident(const std::string& name)
+{
+  this->Mutex.Lock();
+  RemoveDeadEntries();
+  EntryMapType::iterator iterator = this->Entries.find(name);
+  bool resident = (iterator != this->Entries.end()) && GetSize(iterator->second) > 0;
+  this->Mutex.Unlock();
+  return resident;
+}
+
+unsigned long long ImageMemoryManager::GetWorkingSet()
+{
+  this->Mutex.Lock();
+  RemoveDeadEntries();
+  unsigned long long workingSet = 0;
+  for(EntryMapType::const_iterator iterator = this->Entries.begin(); iterator != this->Entries.end(); ++iterator)
+    {
+    workingSet += GetSize(iterator->second);
+    }
+  this->Mutex.Unlock();
+  return workingSet;
+}
+
+bool ImageMemoryManager::EnforceBudget()
+{
+  if(this->Budget == 0)
+    {
+    return true;
+    }
+
+  unsigned long long workingSet = GetWorkingSet();
+
+  this->Mutex.Lock();
+  // Display buffers go first, then intermediates
+  const BufferType evictionOrder[] = {DisplayBuffer, IntermediateBuffer};
+  for(unsigned int pass = 0; pass < 2 && workingSet > this->Budget; ++pass)
+    {
+    while(workingSet > this->Budget)
+      {
+      // Find the least recently used candidate of this type
+      EntryMapType::iterator victim = this->Entries.end();
+      for(EntryMapType::iterator iterator = this->Entries.begin(); iterator != this->Entries.end(); ++iterator)
+        {
+        const Entry& entry = iterator->second;
+        if(entry.Type != evictionOrder[pass] || entry.Pinned || GetSize(entry) == 0)
+          {
+          continue;
+          }
+        if(victim == this->Entries.end() || entry.LastUse < victim->second.LastUse)
+          {
+          victim = iterator;
+          }
+        }
+      if(victim == this->Entries.end())
+        {
+        break;
+        }
+
+      std::cout << "Evicting " << victim->first << " (" << GetSize(victim->second) / (1024 * 1024) << " MB)" << std::endl;
+      workingSet -= GetSize(victim->second);
+      Release(victim->second);
+      }
+    }
+  this->Mutex.Unlock();
+
+  if(workingSet > this->Budget)
+    {
+    std::cerr << "The images use " << workingSet / (1024 * 1024) << " MB, which is over the budget of "
+              << this->Budget / (1024 * 1024) << " MB." << std::endl;
+    return false;
+    }
+  return true;
+}
+
+void ImageMemoryManager::Print(std::ostream& os)
+{
+  this->Mutex.Lock();
+  RemoveDeadEntries();
+  const char* typeNames[] = {"source", "display", "intermediate"};
+  for(EntryMapType::const_iterator iterator = this->Entries.begin(); iterator != this->Entries.end(); ++iterator)
+    {
+    const Entry& entry = iterator->second;
+    os << iterator->first << ": " << GetSize(entry) / 1024 << " KB, " << typeNames[entry.Type]
+       << (entry.Pinned ? ", pinned" : "") << std::endl;
+    }
+  this->Mutex.Unlock();
+}
+
+unsigned long long ImageMemoryManager::GetSize(const Entry& entry) const
+{
+  if(entry.Image)
+    {
+    return ImageSize<FloatVectorImageType>(entry.Image) + ImageSize<FloatVectorVolumeType>(entry.Image) +
+           ImageSize<DeformationFieldType>(entry.Image) +
+           ImageSize<PrecisionTypes<2, FloatPrecision>::DeformationFieldType>(entry.Image);
+    }
+  if(entry.ImageData)
+    {
+    return static_cast<unsigned long long>(entry.ImageData->GetActualMemorySize()) * 1024;
+    }
+  return 0;
+}
+
+void ImageMemoryManager::Release(Entry& entry)
+{
+  // The objects stay alive (and in the pipeline), only their pixel buffers are freed
+  if(entry.Image)
+    {
+    entry.Image->Initialize();
+    }
+  if(entry.ImageData)
+    {
+    entry.ImageData->ReleaseData();
+    }
+}
+
+void ImageMemoryManager::RemoveDeadEntries()
+{
+  // Images that were dropped by their owners no longer count
+  EntryMapType::iterator iterator = this->Entries.begin();
+  while(iterator != this->Entries.end())
+    {
+    const Entry& entry = iterator->second;
+    if((entry.Image && entry.Image->GetReferenceCount() == 1) ||
+       (entry.ImageData && entry.ImageData->GetReferenceCount() == 1))
+      {
+      this->Entries.erase(iterator++);
+      }
+    else
+      {
+      ++iterator;
+      }
+    }
+}
@@ -0,0 +1,101 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef IMAGEMEMORYMANAGER_H
+#define IMAGEMEMORYMANAGER_H
+
+// STL
+#include <map>
+#include <ostream>
+#include <string>
+
+// ITK
+#include "itkSimpleFastMutexLock.h"
+
+// VTK
+#include <vtkSmartPointer.h>
+
+// Custom
+#include "Types.h"
+
+class vtkImageData;
+
+// Keeps track of the image buffers of a session and keeps their total size within a budget.
+// A buffer that nobody but the manager references any more is dropped, so tracking never keeps an image alive.
+// When the budget is exceeded, unpinned buffers that can be regenerated are released: display buffers first
+// (cheap to convert again), then intermediates (which need a recomputation), least recently used first.
+// Source buffers are never released.
+// Whoever owns an evicted buffer must check IsResident() and regenerate it before using it again.
+class ImageMemoryManager
+{
+public:
+  enum BufferType {SourceBuffer, DisplayBuffer, IntermediateBuffer};
+
+  ImageMemoryManager();
+
+  // The budget defaults to half of the physical memory. Zero means no limit.
+  void SetBudget(const unsigned long long bytes);
+  unsigned long long GetBudget() const;
+
+  // Tracking a buffer under an existing name replaces the previous one. New buffers start out pinned.
+  void Track(const std::string& name, FloatVectorImageType* image, const BufferType type);
+  void Track(const std::string& name, FloatVectorVolumeType* volume, const BufferType type);
+  void Track(const std::string& name, vtkImageData* imageData, const BufferType type);
+  // A 2D deformation field of any of the precision policies
+  void Track(const std::string& name, itk::DataObject* deformationField, const BufferType type);
+  void Forget(const std::string& name);
+
+  // Pinned buffers (e.g. the ones on screen) are never evicted
+  void SetPinned(const std::string& name, const bool pinned);
+
+  // Mark a buffer as recently used
+  void Touch(const std::string& name);
+
+  bool IsResident(const std::string& name);
+
+  // The total size of the tracked buffers, in bytes
+  unsigned long long GetWorkingSet();
+
+  // Evict buffers until the working set is within the budget. Returns false if that was not possible.
+  bool EnforceBudget();
+
+  void Print(std::ostream& os);
+
+private:
+  struct Entry
+  {
+    itk::DataObject::Pointer Image;
+    vtkSmartPointer<vtkImageData> ImageData;
+    BufferType Type;
+    bool Pinned;
+    unsigned long LastUse;
+  };
+  typedef std::map<std::string, Entry> EntryMapType;
+
+  unsigned long long GetSize(const Entry& entry) const;
+  void Release(Entry& entry);
+  void Add(const std::string& name, itk::DataObject* image, vtkImageData* imageData, const BufferType type);
+  void RemoveDeadEntries();
+
+  EntryMapType Entries;
+  unsigned long long Budget;
+  unsigned long Clock;
+  itk::SimpleFastMutexLock Mutex;
+};
+
+#endif
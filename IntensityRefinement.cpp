@@ -0,0 +1,289 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IntensityRefinement.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// ITK
+#include "itkAffineTransform.h"
+#include "itkCommand.h"
+#include "itkImageMaskSpatialObject.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkLinearInterpolateImageFunction.h"
+#include "itkMattesMutualInformationImageToImageMetric.h"
+#include "itkMultiResolutionImageRegistrationMethod.h"
+#include "itkRegularStepGradientDescentOptimizer.h"
+#include "itkVectorLinearInterpolateImageFunction.h"
+#include "itkVectorMagnitudeImageFilter.h"
+
+namespace IntensityRefinement
+{
+
+typedef itk::AffineTransform<double, 2> TransformType;
+typedef itk::RegularStepGradientDescentOptimizer OptimizerType;
+typedef itk::MattesMutualInformationImageToImageMetric<FloatScalarImageType, FloatScalarImageType> MetricType;
+typedef itk::LinearInterpolateImageFunction<FloatScalarImageType, double> InterpolatorType;
+typedef itk::MultiResolutionImageRegistrationMethod<FloatScalarImageType, FloatScalarImageType> RegistrationType;
+typedef itk::ImageMaskSpatialObject<2> MaskType;
+typedef PrecisionTypes<2, FloatPrecision>::DeformationFieldType FloatDeformationFieldType;
+
+// Shrink the optimizer steps at the start of each pyramid level, since the finer levels only need to polish
+// the result of the coarser ones.
+class LevelCommand : public itk::Command
+{
+public:
+  typedef LevelCommand Self;
+  typedef itk::Command Superclass;
+  typedef itk::SmartPointer<Self> Pointer;
+  itkNewMacro(Self);
+
+  void SetParameters(const Parameters& parameters)
+  {
+    this->RefinementParameters = parameters;
+  }
+
+  void Execute(itk::Object* caller, const itk::EventObject& event)
+  {
+    if(!(itk::IterationEvent().CheckEvent(&event)))
+      {
+      return;
+      }
+
+    RegistrationType* registration = dynamic_cast<RegistrationType*>(caller);
+    OptimizerType* optimizer = dynamic_cast<OptimizerType*>(registration->GetOptimizer());
+
+    std::cout << "Intensity refinement level " << registration->GetCurrentLevel() << std::endl;
+    if(registration->GetCurrentLevel() == 0)
+      {
+      optimizer->SetMaximumStepLength(0.2);
+      optimizer->SetMinimumStepLength(this->RefinementParameters.MinimumStepLength);
+      }
+    else
+      {
+      optimizer->SetMaximumStepLength(optimizer->GetMaximumStepLength() * 0.5);
+      optimizer->SetMinimumStepLength(optimizer->GetMinimumStepLength() * 0.5);
+      }
+  }
+
+  void Execute(const itk::Object*, const itk::EventObject&)
+  {
+  }
+
+protected:
+  LevelCommand() {}
+
+private:
+  Parameters RefinementParameters;
+};
+
+static FloatScalarImageType::Pointer ComputeMagnitude(FloatVectorImageType::Pointer image)
+{
+  typedef itk::VectorMagnitudeImageFilter<FloatVectorImageType, FloatScalarImageType> VectorMagnitudeFilterType;
+  VectorMagnitudeFilterType::Pointer magnitudeFilter = VectorMagnitudeFilterType::New();
+  magnitudeFilter->SetInput(image);
+  magnitudeFilter->Update();
+
+  FloatScalarImageType::Pointer magnitude = magnitudeFilter->GetOutput();
+  magnitude->DisconnectPipeline();
+  return magnitude;
+}
+
+// Mark the fixed pixels that the field maps inside the moving image. The rest of the warped moving image
+// is filled with the resampler's default value and would only mislead the metric. This relies on the field
+// going from fixed points to moving points, as LandmarkRegistration::ComputeDeformationField makes it.
+template <typename TDeformationField>
+static MaskType::Pointer ComputeOverlapMask(FloatVectorImageType::Pointer movingImage,
+                                            TDeformationField* deformationField)
+{
+  UnsignedCharScalarImageType::Pointer maskImage = UnsignedCharScalarImageType::New();
+  maskImage->CopyInformation(deformationField);
+  maskImage->SetRegions(deformationField->GetLargestPossibleRegion());
+  maskImage->Allocate();
+
+  itk::ImageRegionConstIteratorWithIndex<TDeformationField> fieldIterator(deformationField,
+                                                                          deformationField->GetLargestPossibleRegion());
+  itk::ImageRegionIterator<UnsignedCharScalarImageType> maskIterator(maskImage, maskImage->GetLargestPossibleRegion());
+
+  while(!fieldIterator.IsAtEnd())
+    {
+    ImageTypes<2>::PointType point;
+    deformationField->TransformIndexToPhysicalPoint(fieldIterator.GetIndex(), point);
+    for(unsigned int i = 0; i < 2; ++i)
+      {
+      point[i] += fieldIterator.Get()[i];
+      }
+
+    ContinuousIndexType movingIndex;
+    maskIterator.Set(movingImage->TransformPhysicalPointToContinuousIndex(point, movingIndex) ? 255 : 0);
+
+    ++fieldIterator;
+    ++maskIterator;
+    }
+
+  MaskType::Pointer mask = MaskType::New();
+  mask->SetImage(maskImage);
+  return mask;
+}
+
+// The refined mapping of a fixed point x is field(A(x)), i.e. A(x) + d(A(x)).
+template <typename TDeformationField>
+static typename TDeformationField::Pointer ComposeDeformationField(TDeformationField* deformationField,
+                                                                   const TransformType* transform)
+{
+  typedef itk::VectorLinearInterpolateImageFunction<TDeformationField, double> FieldInterpolatorType;
+
+  typename TDeformationField::Pointer composedField = TDeformationField::New();
+  composedField->CopyInformation(deformationField);
+  composedField->SetRegions(deformationField->GetLargestPossibleRegion());
+  composedField->Allocate();
+
+  typename FieldInterpolatorType::Pointer interpolator = FieldInterpolatorType::New();
+  interpolator->SetInputImage(deformationField);
+
+  // Points that the affine transform moves off the field use the displacement at the nearest field position
+  const typename TDeformationField::RegionType region = deformationField->GetLargestPossibleRegion();
+
+  itk::ImageRegionIteratorWithIndex<TDeformationField> composedIterator(composedField, region);
+  while(!composedIterator.IsAtEnd())
+    {
+    ImageTypes<2>::PointType fixedPoint;
+    composedField->TransformIndexToPhysicalPoint(composedIterator.GetIndex(), fixedPoint);
+    const ImageTypes<2>::PointType transformedPoint = transform->TransformPoint(fixedPoint);
+
+    ContinuousIndexType fieldIndex;
+    deformationField->TransformPhysicalPointToContinuousIndex(transformedPoint, fieldIndex);
+    for(unsigned int i = 0; i < 2; ++i)
+      {
+      fieldIndex[i] = std::max(fieldIndex[i], static_cast<double>(region.GetIndex()[i]));
+      fieldIndex[i] = std::min(fieldIndex[i], static_cast<double>(region.GetIndex()[i] + region.GetSize()[i] - 1));
+      }
+
+    const typename FieldInterpolatorType::OutputType displacement = interpolator->EvaluateAtContinuousIndex(fieldIndex);
+    typename TDeformationField::PixelType composedDisplacement;
+    for(unsigned int i = 0; i < 2; ++i)
+      {
+      composedDisplacement[i] = static_cast<typename TDeformationField::PixelType::ValueType>(
+        transformedPoint[i] + displacement[i] - fixedPoint[i]);
+      }
+    composedIterator.Set(composedDisplacement);
+
+    ++composedIterator;
+    }
+
+  return composedField;
+}
+
+template <typename TDeformationField>
+typename TDeformationField::Pointer RefineDeformationField(FloatVectorImageType::Pointer fixedImage,
+                                                           FloatVectorImageType::Pointer warpedMovingImage,
+                                                           FloatVectorImageType::Pointer movingImage,
+                                                           typename TDeformationField::Pointer deformationField,
+                                                           const Parameters& parameters)
+{
+  FloatScalarImageType::Pointer fixedMagnitude = ComputeMagnitude(fixedImage);
+  FloatScalarImageType::Pointer warpedMovingMagnitude = ComputeMagnitude(warpedMovingImage);
+
+  // The landmark field has already been applied, so start from the identity, centered on the image so
+  // that rotation and translation are decoupled.
+  TransformType::Pointer transform = TransformType::New();
+  transform->SetIdentity();
+  const FloatScalarImageType::RegionType region = fixedMagnitude->GetLargestPossibleRegion();
+  ContinuousIndexType centerIndex;
+  for(unsigned int i = 0; i < 2; ++i)
+    {
+    centerIndex[i] = region.GetIndex()[i] + (region.GetSize()[i] - 1) / 2.0;
+    }
+  TransformType::InputPointType center;
+  fixedMagnitude->TransformContinuousIndexToPhysicalPoint(centerIndex, center);
+  transform->SetCenter(center);
+
+  // Bring the translations (in physical units) to the scale of the matrix entries
+  double diagonal = 0;
+  for(unsigned int i = 0; i < 2; ++i)
+    {
+    const double extent = region.GetSize()[i] * fixedMagnitude->GetSpacing()[i];
+    diagonal += extent * extent;
+    }
+  diagonal = std::sqrt(diagonal);
+
+  OptimizerType::ScalesType scales(transform->GetNumberOfParameters());
+  scales.Fill(1.0);
+  scales[4] = 1.0 / diagonal;
+  scales[5] = 1.0 / diagonal;
+
+  OptimizerType::Pointer optimizer = OptimizerType::New();
+  optimizer->SetScales(scales);
+  optimizer->SetNumberOfIterations(parameters.MaximumIterationsPerLevel);
+  optimizer->SetRelaxationFactor(0.5);
+
+  // Only a random subset of the pixels is used at each level. The seed is fixed so repeated runs agree.
+  MetricType::Pointer metric = MetricType::New();
+  metric->SetNumberOfHistogramBins(parameters.NumberOfHistogramBins);
+  metric->SetNumberOfSpatialSamples(std::min(parameters.NumberOfSpatialSamples,
+                                             static_cast<unsigned int>(region.GetNumberOfPixels())));
+  metric->SetUseAllPixels(false);
+  metric->ReinitializeSeed(76926294);
+  metric->SetFixedImageMask(ComputeOverlapMask<TDeformationField>(movingImage, deformationField));
+
+  RegistrationType::Pointer registration = RegistrationType::New();
+  registration->SetOptimizer(optimizer);
+  registration->SetTransform(transform);
+  registration->SetInterpolator(InterpolatorType::New());
+  registration->SetMetric(metric);
+  registration->SetFixedImage(fixedMagnitude);
+  registration->SetMovingImage(warpedMovingMagnitude);
+  registration->SetFixedImageRegion(region);
+  registration->SetInitialTransformParameters(transform->GetParameters());
+  registration->SetNumberOfLevels(parameters.NumberOfLevels);
+
+  LevelCommand::Pointer levelCommand = LevelCommand::New();
+  levelCommand->SetParameters(parameters);
+  registration->AddObserver(itk::IterationEvent(), levelCommand);
+
+  try
+    {
+    registration->Update();
+    }
+  catch(itk::ExceptionObject& error)
+    {
+    std::cerr << "Intensity refinement failed: " << error << std::endl;
+    return deformationField;
+    }
+
+  std::cout << "Intensity refinement stopped after " << optimizer->GetCurrentIteration()
+            << " iterations at the finest level: " << optimizer->GetStopConditionDescription() << std::endl;
+
+  transform->SetParameters(registration->GetLastTransformParameters());
+  return ComposeDeformationField<TDeformationField>(deformationField, transform);
+}
+
+// The fields of the double policy, and of the float and mixed policies
+template DeformationFieldType::Pointer RefineDeformationField<DeformationFieldType>(
+  FloatVectorImageType::Pointer, FloatVectorImageType::Pointer, FloatVectorImageType::Pointer,
+  DeformationFieldType::Pointer, const Parameters&);
+template FloatDeformationFieldType::Pointer RefineDeformationField<FloatDeformationFieldType>(
+  FloatVectorImageType::Pointer, FloatVectorImageType::Pointer, FloatVectorImageType::Pointer,
+  FloatDeformationFieldType::Pointer, const Parameters&);
+
+} // end namespace
@@ -0,0 +1,56 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef INTENSITYREFINEMENT_H
+#define INTENSITYREFINEMENT_H
+
+// Custom
+#include "PrecisionPolicy.h"
+#include "Types.h"
+
+namespace IntensityRefinement
+{
+
+struct Parameters
+{
+  Parameters() : NumberOfLevels(3), NumberOfSpatialSamples(20000), NumberOfHistogramBins(32),
+                 MaximumIterationsPerLevel(100), MinimumStepLength(0.001) {}
+
+  unsigned int NumberOfLevels;
+  unsigned int NumberOfSpatialSamples; // Random fixed image pixels used by the metric at each level
+  unsigned int NumberOfHistogramBins;
+  unsigned int MaximumIterationsPerLevel;
+  double MinimumStepLength; // A level stops early once the optimizer step falls below this
+};
+
+// Refine a landmark deformation field against the image content. 'warpedMovingImage' is the moving image
+// already resampled onto the fixed grid through 'deformationField'. It is registered to 'fixedImage' with
+// a multi-resolution affine registration (Mattes mutual information on the pixel magnitudes). The affine
+// transform is then folded into a new field, so a single resampling of the original moving image gives the
+// refined result. Returns 'deformationField' itself if the registration fails.
+// Instantiated for the double and float fields of the precision policies.
+template <typename TDeformationField>
+typename TDeformationField::Pointer RefineDeformationField(FloatVectorImageType::Pointer fixedImage,
+                                                           FloatVectorImageType::Pointer warpedMovingImage,
+                                                           FloatVectorImageType::Pointer movingImage,
+                                                           typename TDeformationField::Pointer deformationField,
+                                                           const Parameters& parameters = Parameters());
+
+} // end namespace
+
+#endif
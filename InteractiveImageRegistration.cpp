@@ -19,15 +19,40 @@
 #include <QApplication>
 #include <QCleanlooksStyle>
 
+#include <cstdlib>
+#include <iostream>
+
 #include "Form.h"
 
 int main( int argc, char** argv )
 {
+  // Usage: InteractiveImageRegistration [fixedImage movingImage [fixedLandmarks movingLandmarks]]
+  if(argc != 1 && argc != 3 && argc != 5)
+    {
+    std::cerr << "Usage: " << argv[0] << " [fixedImage movingImage [fixedLandmarks movingLandmarks]]" << std::endl;
+    return EXIT_FAILURE;
+    }
+
   QApplication app( argc, argv );
 
   QApplication::setStyle(new QCleanlooksStyle);
 
   Form myForm;
+
+  // The images load in the background while the window comes up
+  if(argc >= 3)
+    {
+    std::string fixedLandmarks;
+    std::string movingLandmarks;
+    if(argc == 5)
+      {
+      fixedLandmarks = argv[3];
+      movingLandmarks = argv[4];
+      }
+    myForm.LoadFixedImage(argv[1], fixedLandmarks);
+    myForm.LoadMovingImage(argv[2], movingLandmarks);
+    }
+
   myForm.show();
 
   return app.exec();
@@ -0,0 +1,315 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "LandmarkRefinement.h"
+
+// STL
+#include <cmath>
+#include <iostream>
+
+// ITK
+#include "itkMultiThreader.h"
+
+// VNL
+#include <vcl_complex.h>
+#include <vnl/vnl_matrix.h>
+#include <vnl/algo/vnl_fft_2d.h>
+
+namespace LandmarkRefinement
+{
+
+// Matches with a normalized cross correlation below this are considered unreliable and ignored.
+static const double MinimumCorrelation = 0.5;
+
+// Data shared by all of the threads of RefineMovingLandmarks
+struct RefinementThreadData
+{
+  const FloatVectorImageType* FixedImage;
+  const FloatVectorImageType* MovingImage;
+  const std::vector<ContinuousIndexType>* FixedLandmarks;
+  std::vector<ContinuousIndexType>* MovingLandmarks;
+  std::vector<unsigned char>* Refined; // Not vector<bool>, its elements can't be written from different threads
+  unsigned int PatchRadius;
+  unsigned int SearchRadius;
+};
+
+// Copy the magnitude of the pixels in the square of the given radius around 'center' into 'patch'.
+// Returns false if the square is not entirely inside the image.
+static bool ExtractMagnitudePatch(const FloatVectorImageType* image, const itk::Index<2>& center,
+                                  const unsigned int radius, vnl_matrix<double>& patch)
+{
+  const FloatVectorImageType::RegionType region = image->GetLargestPossibleRegion();
+  const long width = static_cast<long>(region.GetSize()[0]);
+  const long height = static_cast<long>(region.GetSize()[1]);
+  const long r = static_cast<long>(radius);
+
+  const long x0 = center[0] - region.GetIndex()[0] - r;
+  const long y0 = center[1] - region.GetIndex()[1] - r;
+  if(x0 < 0 || y0 < 0 || x0 + 2*r >= width || y0 + 2*r >= height)
+    {
+    return false;
+    }
+
+  const unsigned int components = image->GetNumberOfComponentsPerPixel();
+  const float* buffer = image->GetBufferPointer();
+
+  patch.set_size(2*radius + 1, 2*radius + 1);
+  for(unsigned int row = 0; row < patch.rows(); ++row)
+    {
+    const float* pixel = buffer + ((y0 + row) * width + x0) * components;
+    for(unsigned int column = 0; column < patch.cols(); ++column)
+      {
+      double sumOfSquares = 0;
+      for(unsigned int component = 0; component < components; ++component)
+        {
+        sumOfSquares += pixel[component] * pixel[component];
+        }
+      patch(row, column) = std::sqrt(sumOfSquares);
+      pixel += components;
+      }
+    }
+  return true;
+}
+
+// Fit a parabola through three samples and return the offset of its extremum from the center sample.
+static double ParabolicPeakOffset(const double left, const double center, const double right)
+{
+  const double denominator = left - 2.0 * center + right;
+  if(denominator >= 0) // Not a maximum
+    {
+    return 0;
+    }
+  double offset = 0.5 * (left - right) / denominator;
+  if(offset > 0.5)
+    {
+    offset = 0.5;
+    }
+  else if(offset < -0.5)
+    {
+    offset = -0.5;
+    }
+  return offset;
+}
+
+static unsigned int NextPowerOfTwo(const unsigned int value)
+{
+  unsigned int powerOfTwo = 1;
+  while(powerOfTwo < value)
+    {
+    powerOfTwo *= 2;
+    }
+  return powerOfTwo;
+}
+
+bool RefineMovingLandmark(const FloatVectorImageType* fixedImage, const FloatVectorImageType* movingImage,
+                          const ContinuousIndexType& fixedLandmark, ContinuousIndexType& movingLandmark,
+                          const unsigned int patchRadius, const unsigned int searchRadius)
+{
+  // The template is centered on the pixel nearest the fixed landmark and the search window on the pixel
+  // nearest the moving landmark. The sub-pixel part of the fixed landmark is carried over to the result.
+  itk::Index<2> fixedCenter;
+  itk::Index<2> movingCenter;
+  double fixedFraction[2];
+  for(unsigned int i = 0; i < 2; ++i)
+    {
+    fixedCenter[i] = static_cast<long>(std::floor(fixedLandmark[i] + 0.5));
+    movingCenter[i] = static_cast<long>(std::floor(movingLandmark[i] + 0.5));
+    fixedFraction[i] = fixedLandmark[i] - fixedCenter[i];
+    }
+
+  vnl_matrix<double> patch;
+  vnl_matrix<double> window;
+  if(!ExtractMagnitudePatch(fixedImage, fixedCenter, patchRadius, patch) ||
+     !ExtractMagnitudePatch(movingImage, movingCenter, patchRadius + searchRadius, window))
+    {
+    return false;
+    }
+
+  // Zero mean template
+  const double patchPixels = patch.rows() * patch.cols();
+  patch -= patch.mean();
+  const double patchNorm = patch.frobenius_norm();
+  if(patchNorm <= 0) // A flat template can match anything
+    {
+    return false;
+    }
+
+  // Cross correlate the template with the window in the frequency domain. The padded size is at least the
+  // window size, so the circular correlation equals the linear one at every valid offset.
+  const unsigned int fftSize = NextPowerOfTwo(window.rows());
+  vnl_matrix<vcl_complex<double> > windowSpectrum(fftSize, fftSize, vcl_complex<double>(0, 0));
+  vnl_matrix<vcl_complex<double> > patchSpectrum(fftSize, fftSize, vcl_complex<double>(0, 0));
+  for(unsigned int row = 0; row < window.rows(); ++row)
+    {
+    for(unsigned int column = 0; column < window.cols(); ++column)
+      {
+      windowSpectrum(row, column) = window(row, column);
+      }
+    }
+  for(unsigned int row = 0; row < patch.rows(); ++row)
+    {
+    for(unsigned int column = 0; column < patch.cols(); ++column)
+      {
+      patchSpectrum(row, column) = patch(row, column);
+      }
+    }
+
+  vnl_fft_2d<double> fft(fftSize, fftSize);
+  fft.fwd_transform(windowSpectrum);
+  fft.fwd_transform(patchSpectrum);
+  for(unsigned int row = 0; row < fftSize; ++row)
+    {
+    for(unsigned int column = 0; column < fftSize; ++column)
+      {
+      windowSpectrum(row, column) *= vcl_conj(patchSpectrum(row, column));
+      }
+    }
+  fft.bwd_transform(windowSpectrum); // Not normalized
+
+  // Summed area tables of the window and its square give the local statistics for the denominator.
+  vnl_matrix<double> sum(window.rows() + 1, window.cols() + 1, 0.0);
+  vnl_matrix<double> sumOfSquares(window.rows() + 1, window.cols() + 1, 0.0);
+  for(unsigned int row = 0; row < window.rows(); ++row)
+    {
+    for(unsigned int column = 0; column < window.cols(); ++column)
+      {
+      const double value = window(row, column);
+      sum(row + 1, column + 1) = value + sum(row, column + 1) + sum(row + 1, column) - sum(row, column);
+      sumOfSquares(row + 1, column + 1) = value * value + sumOfSquares(row, column + 1) +
+                                          sumOfSquares(row + 1, column) - sumOfSquares(row, column);
+      }
+    }
+
+  const unsigned int offsets = 2 * searchRadius + 1;
+  const unsigned int patchSize = patch.rows();
+  const double normalization = 1.0 / (fftSize * fftSize);
+  vnl_matrix<double> correlation(offsets, offsets, 0.0);
+  unsigned int bestRow = 0;
+  unsigned int bestColumn = 0;
+  for(unsigned int row = 0; row < offsets; ++row)
+    {
+    for(unsigned int column = 0; column < offsets; ++column)
+      {
+      const unsigned int lastRow = row + patchSize;
+      const unsigned int lastColumn = column + patchSize;
+      const double localSum = sum(lastRow, lastColumn) - sum(row, lastColumn) - sum(lastRow, column) + sum(row, column);
+      const double localSumOfSquares = sumOfSquares(lastRow, lastColumn) - sumOfSquares(row, lastColumn) -
+                                       sumOfSquares(lastRow, column) + sumOfSquares(row, column);
+      const double localVariance = localSumOfSquares - localSum * localSum / patchPixels;
+      if(localVariance > 0)
+        {
+        correlation(row, column) = windowSpectrum(row, column).real() * normalization / (patchNorm * std::sqrt(localVariance));
+        }
+      if(correlation(row, column) > correlation(bestRow, bestColumn))
+        {
+        bestRow = row;
+        bestColumn = column;
+        }
+      }
+    }
+
+  if(correlation(bestRow, bestColumn) < MinimumCorrelation)
+    {
+    return false;
+    }
+
+  double offset[2];
+  offset[0] = static_cast<double>(bestColumn) - searchRadius;
+  offset[1] = static_cast<double>(bestRow) - searchRadius;
+  if(bestColumn > 0 && bestColumn < offsets - 1)
+    {
+    offset[0] += ParabolicPeakOffset(correlation(bestRow, bestColumn - 1), correlation(bestRow, bestColumn),
+                                     correlation(bestRow, bestColumn + 1));
+    }
+  if(bestRow > 0 && bestRow < offsets - 1)
+    {
+    offset[1] += ParabolicPeakOffset(correlation(bestRow - 1, bestColumn), correlation(bestRow, bestColumn),
+                                     correlation(bestRow + 1, bestColumn));
+    }
+
+  for(unsigned int i = 0; i < 2; ++i)
+    {
+    movingLandmark[i] = movingCenter[i] + offset[i] + fixedFraction[i];
+    }
+  return true;
+}
+
+static ITK_THREAD_RETURN_TYPE RefineMovingLandmarksThreaded(void* arg)
+{
+  itk::MultiThreader::ThreadInfoStruct* threadInfo = static_cast<itk::MultiThreader::ThreadInfoStruct*>(arg);
+  RefinementThreadData* data = static_cast<RefinementThreadData*>(threadInfo->UserData);
+
+  // Interleave the pairs over the threads
+  for(unsigned int pairId = threadInfo->ThreadID; pairId < data->FixedLandmarks->size(); pairId += threadInfo->NumberOfThreads)
+    {
+    (*data->Refined)[pairId] = RefineMovingLandmark(data->FixedImage, data->MovingImage,
+                                                    (*data->FixedLandmarks)[pairId], (*data->MovingLandmarks)[pairId],
+                                                    data->PatchRadius, data->SearchRadius);
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+unsigned int RefineMovingLandmarks(FloatVectorImageType::Pointer fixedImage, FloatVectorImageType::Pointer movingImage,
+                                   const std::vector<ContinuousIndexType>& fixedLandmarks,
+                                   std::vector<ContinuousIndexType>& movingLandmarks,
+                                   const unsigned int patchRadius, const unsigned int searchRadius)
+{
+  if(fixedLandmarks.size() != movingLandmarks.size())
+    {
+    std::cerr << "RefineMovingLandmarks: the number of fixed and moving landmarks must match!" << std::endl;
+    return 0;
+    }
+  if(fixedLandmarks.empty())
+    {
+    return 0;
+    }
+
+  std::vector<unsigned char> refined(fixedLandmarks.size(), false);
+
+  RefinementThreadData data;
+  data.FixedImage = fixedImage;
+  data.MovingImage = movingImage;
+  data.FixedLandmarks = &fixedLandmarks;
+  data.MovingLandmarks = &movingLandmarks;
+  data.Refined = &refined;
+  data.PatchRadius = patchRadius;
+  data.SearchRadius = searchRadius;
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  int numberOfThreads = threader->GetNumberOfThreads();
+  if(numberOfThreads > static_cast<int>(fixedLandmarks.size()))
+    {
+    numberOfThreads = static_cast<int>(fixedLandmarks.size());
+    }
+  threader->SetNumberOfThreads(numberOfThreads);
+  threader->SetSingleMethod(RefineMovingLandmarksThreaded, &data);
+  threader->SingleMethodExecute();
+
+  unsigned int numberRefined = 0;
+  for(unsigned int pairId = 0; pairId < refined.size(); ++pairId)
+    {
+    if(refined[pairId])
+      {
+      numberRefined++;
+      }
+    }
+  return numberRefined;
+}
+
+} // end namespace
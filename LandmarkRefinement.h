@@ -0,0 +1,48 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef LANDMARKREFINEMENT_H
+#define LANDMARKREFINEMENT_H
+
+// STL
+#include <vector>
+
+// Custom
+#include "Types.h"
+
+namespace LandmarkRefinement
+{
+
+// Move each moving landmark to the position in a window around it where the patch best matches
+// (by normalized cross correlation) the patch around the corresponding fixed landmark.
+// Landmarks are in continuous pixel coordinates. Pairs are processed in parallel.
+// Returns the number of landmarks that were moved.
+unsigned int RefineMovingLandmarks(FloatVectorImageType::Pointer fixedImage, FloatVectorImageType::Pointer movingImage,
+                                   const std::vector<ContinuousIndexType>& fixedLandmarks,
+                                   std::vector<ContinuousIndexType>& movingLandmarks,
+                                   const unsigned int patchRadius = 7, const unsigned int searchRadius = 10);
+
+// Refine a single landmark pair. Returns false (and leaves movingLandmark untouched) if the
+// windows leave the image or no sufficiently good match was found.
+bool RefineMovingLandmark(const FloatVectorImageType* fixedImage, const FloatVectorImageType* movingImage,
+                          const ContinuousIndexType& fixedLandmark, ContinuousIndexType& movingLandmark,
+                          const unsigned int patchRadius, const unsigned int searchRadius);
+
+} // end namespace
+
+#endif
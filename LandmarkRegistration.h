@@ -0,0 +1,480 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef LANDMARKREGISTRATION_H
+#define LANDMARKREGISTRATION_H
+
+// STL
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+// ITK
+#include "itkDeformationFieldTransform.h"
+#include "itkImageBase.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkMultiThreader.h"
+#include "itkVectorLinearInterpolateImageFunction.h"
+
+// Custom
+#include "LeaveOneOutKernelTransform.h"
+#include "PrecisionPolicy.h"
+#include "ResampleIntoBufferFilter.h"
+#include "Types.h"
+
+// The landmark registration core, for images and volumes: a thin plate spline through the landmark pairs is
+// sampled into a deformation field on the fixed grid, and the moving image is resampled through it.
+// Everything is parameterized by a precision policy (see PrecisionPolicy.h).
+namespace LandmarkRegistration
+{
+
+// The field is computed in tiles of this many pixels along each axis. The tiles are spread over the threads.
+static const unsigned int TileSize = 32;
+
+template <unsigned int TDimension, typename TPrecision>
+struct DeformationFieldThreadData
+{
+  typedef LeaveOneOutKernelTransform<typename TPrecision::SolveType, TDimension> KernelTransformType;
+  typedef typename PrecisionTypes<TDimension, TPrecision>::DeformationFieldType DeformationFieldType;
+
+  const KernelTransformType* KernelTransform;
+  DeformationFieldType* DeformationField;
+  std::vector<itk::ImageRegion<TDimension> > Tiles;
+};
+
+template <unsigned int TDimension, typename TPrecision>
+ITK_THREAD_RETURN_TYPE ComputeDeformationFieldThreaded(void* arg)
+{
+  typedef DeformationFieldThreadData<TDimension, TPrecision> ThreadDataType;
+  typedef typename ThreadDataType::KernelTransformType KernelTransformType;
+  typedef typename ThreadDataType::DeformationFieldType DeformationFieldType;
+
+  itk::MultiThreader::ThreadInfoStruct* threadInfo = static_cast<itk::MultiThreader::ThreadInfoStruct*>(arg);
+  ThreadDataType* data = static_cast<ThreadDataType*>(threadInfo->UserData);
+
+  // KernelTransform::TransformPoint only reads the solved system, so the threads can share the transform
+  for(unsigned int tileId = threadInfo->ThreadID; tileId < data->Tiles.size(); tileId += threadInfo->NumberOfThreads)
+    {
+    itk::ImageRegionIteratorWithIndex<DeformationFieldType> fieldIterator(data->DeformationField, data->Tiles[tileId]);
+    while(!fieldIterator.IsAtEnd())
+      {
+      typename KernelTransformType::InputPointType fixedPoint;
+      data->DeformationField->TransformIndexToPhysicalPoint(fieldIterator.GetIndex(), fixedPoint);
+      const typename KernelTransformType::OutputVectorType displacement =
+        data->KernelTransform->TransformPoint(fixedPoint) - fixedPoint;
+      typename DeformationFieldType::PixelType fieldValue;
+      for(unsigned int i = 0; i < TDimension; ++i)
+        {
+        fieldValue[i] = static_cast<typename TPrecision::FieldValueType>(displacement[i]);
+        }
+      fieldIterator.Set(fieldValue);
+      ++fieldIterator;
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+// Split a region into tiles of at most TileSize pixels along each axis
+template <unsigned int TDimension>
+std::vector<itk::ImageRegion<TDimension> > ComputeTiles(const itk::ImageRegion<TDimension>& region)
+{
+  std::vector<itk::ImageRegion<TDimension> > tiles;
+
+  itk::Index<TDimension> tileCorner = region.GetIndex();
+  while(true)
+    {
+    itk::ImageRegion<TDimension> tile;
+    tile.SetIndex(tileCorner);
+    for(unsigned int i = 0; i < TDimension; ++i)
+      {
+      const long regionEnd = region.GetIndex()[i] + static_cast<long>(region.GetSize()[i]);
+      tile.SetSize(i, std::min(static_cast<long>(TileSize), regionEnd - tileCorner[i]));
+      }
+    tiles.push_back(tile);
+
+    // Advance the corner like an odometer, x fastest
+    unsigned int axis = 0;
+    for(; axis < TDimension; ++axis)
+      {
+      tileCorner[axis] += TileSize;
+      if(tileCorner[axis] < region.GetIndex()[axis] + static_cast<long>(region.GetSize()[axis]))
+        {
+        break;
+        }
+      tileCorner[axis] = region.GetIndex()[axis];
+      }
+    if(axis == TDimension)
+      {
+      break;
+      }
+    }
+
+  return tiles;
+}
+
+// Compute the displacement field on the grid of 'fixedImage' that takes each fixed landmark to its moving
+// landmark. The landmarks are physical points.
+// If 'leaveOneOutErrors' is given, it receives the leave-one-out error of each landmark pair in physical units of
+// the moving image (see LeaveOneOutKernelTransform), or is left empty if they are not available.
+template <unsigned int TDimension, typename TPrecision>
+typename PrecisionTypes<TDimension, TPrecision>::DeformationFieldType::Pointer
+ComputeDeformationField(const itk::ImageBase<TDimension>* fixedImage,
+                        const std::vector<typename ImageTypes<TDimension>::PointType>& fixedLandmarks,
+                        const std::vector<typename ImageTypes<TDimension>::PointType>& movingLandmarks,
+                        std::vector<typename ImageTypes<TDimension>::DeformationVectorType>* leaveOneOutErrors = NULL)
+{
+  typedef DeformationFieldThreadData<TDimension, TPrecision> ThreadDataType;
+  typedef typename ThreadDataType::KernelTransformType KernelTransformType;
+  typedef typename ThreadDataType::DeformationFieldType DeformationFieldType;
+
+  // The field is sampled at fixed points, so the kernel transform goes from the fixed to the moving landmarks
+  typename KernelTransformType::PointSetType::Pointer sourceLandmarks = KernelTransformType::PointSetType::New();
+  typename KernelTransformType::PointSetType::Pointer targetLandmarks = KernelTransformType::PointSetType::New();
+  for(unsigned int i = 0; i < fixedLandmarks.size(); ++i)
+    {
+    typename KernelTransformType::InputPointType sourcePoint;
+    sourcePoint.CastFrom(fixedLandmarks[i]);
+    sourceLandmarks->GetPoints()->InsertElement(i, sourcePoint);
+    typename KernelTransformType::InputPointType targetPoint;
+    targetPoint.CastFrom(movingLandmarks[i]);
+    targetLandmarks->GetPoints()->InsertElement(i, targetPoint);
+    }
+
+  typename KernelTransformType::Pointer kernelTransform = KernelTransformType::New();
+  kernelTransform->SetSourceLandmarks(sourceLandmarks);
+  kernelTransform->SetTargetLandmarks(targetLandmarks);
+  kernelTransform->ComputeWMatrixAndLeaveOneOutErrors();
+
+  if(leaveOneOutErrors)
+    {
+    const std::vector<typename KernelTransformType::OutputVectorType>& errors = kernelTransform->GetLeaveOneOutErrors();
+    leaveOneOutErrors->resize(errors.size());
+    for(unsigned int i = 0; i < errors.size(); ++i)
+      {
+      for(unsigned int j = 0; j < TDimension; ++j)
+        {
+        (*leaveOneOutErrors)[i][j] = errors[i][j];
+        }
+      }
+    }
+
+  typename DeformationFieldType::Pointer deformationField = DeformationFieldType::New();
+  deformationField->CopyInformation(fixedImage);
+  deformationField->SetRegions(fixedImage->GetLargestPossibleRegion());
+  deformationField->Allocate();
+
+  ThreadDataType data;
+  data.KernelTransform = kernelTransform;
+  data.DeformationField = deformationField;
+  data.Tiles = ComputeTiles<TDimension>(deformationField->GetLargestPossibleRegion());
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(std::min(threader->GetNumberOfThreads(), static_cast<int>(data.Tiles.size())));
+  threader->SetSingleMethod(ComputeDeformationFieldThreaded<TDimension, TPrecision>, &data);
+  threader->SingleMethodExecute();
+
+  return deformationField;
+}
+
+// Resample the moving image onto the grid of 'fixedImage' through the deformation field. The resampler is
+// multithreaded itself, each thread handling a slab of the output. The field is interpolated, and the
+// resampler computes its coordinates, in the field's precision.
+// If 'outputBuffer' is given, the warped pixels are written straight into it and the image returned wraps it without
+// owning it. It must hold outputBufferLength >= (fixed pixels) * (moving components) floats.
+template <unsigned int TDimension, typename TPrecision>
+typename ImageTypes<TDimension>::FloatVectorImageType::Pointer
+WarpImage(typename ImageTypes<TDimension>::FloatVectorImageType* movingImage,
+          typename PrecisionTypes<TDimension, TPrecision>::DeformationFieldType* deformationField,
+          const itk::ImageBase<TDimension>* fixedImage,
+          float* outputBuffer = NULL, const std::size_t outputBufferLength = 0)
+{
+  typedef typename ImageTypes<TDimension>::FloatVectorImageType FloatVectorImageType;
+  typedef typename TPrecision::FieldValueType FieldValueType;
+
+  typedef itk::DeformationFieldTransform<FieldValueType, TDimension>  DeformationFieldTransformType;
+  typename DeformationFieldTransformType::Pointer deformationFieldTransform = DeformationFieldTransformType::New();
+  deformationFieldTransform->SetDeformationField( deformationField );
+
+  typedef ResampleIntoBufferFilter<FloatVectorImageType, FloatVectorImageType, FieldValueType>    VectorResampleFilterType;
+  typename VectorResampleFilterType::Pointer vectorResampleFilter = VectorResampleFilterType::New();
+  vectorResampleFilter->SetOutputBuffer( outputBuffer, outputBufferLength );
+  vectorResampleFilter->SetInput( movingImage );
+  vectorResampleFilter->SetTransform( deformationFieldTransform );
+  vectorResampleFilter->SetSize( fixedImage->GetLargestPossibleRegion().GetSize() );
+  vectorResampleFilter->SetOutputOrigin(  fixedImage->GetOrigin() );
+  vectorResampleFilter->SetOutputSpacing( fixedImage->GetSpacing() );
+  vectorResampleFilter->SetOutputDirection( fixedImage->GetDirection() );
+  vectorResampleFilter->SetDefaultPixelValue( 200 ); // This is the color which to set portions of the transformed image that do not correspond to the moving image
+  vectorResampleFilter->Update();
+
+  // Take over the resampler's output rather than copying it
+  typename FloatVectorImageType::Pointer warpedImage = vectorResampleFilter->GetOutput();
+  warpedImage->DisconnectPipeline();
+  return warpedImage;
+}
+
+template <typename TDeformationField>
+struct InverseDeformationFieldThreadData
+{
+  typedef itk::VectorLinearInterpolateImageFunction<TDeformationField, double> InterpolatorType;
+
+  const InterpolatorType* Interpolator;
+  TDeformationField* InverseDeformationField;
+  std::vector<itk::ImageRegion<TDeformationField::ImageDimension> > Tiles;
+  unsigned int MaximumIterations;
+  double Tolerance;
+  std::vector<unsigned long> NumberOfUnconverged; // One entry per thread
+};
+
+// The displacement of the field at 'point'. Points off the field use the displacement at the nearest field position.
+template <typename TInterpolator>
+typename TInterpolator::OutputType EvaluateField(const TInterpolator* interpolator,
+                                                 const typename TInterpolator::PointType& point)
+{
+  typedef typename TInterpolator::InputImageType DeformationFieldType;
+  const DeformationFieldType* deformationField = interpolator->GetInputImage();
+  const typename DeformationFieldType::RegionType region = deformationField->GetLargestPossibleRegion();
+
+  typename TInterpolator::ContinuousIndexType index;
+  deformationField->TransformPhysicalPointToContinuousIndex(point, index);
+  for(unsigned int i = 0; i < DeformationFieldType::ImageDimension; ++i)
+    {
+    index[i] = std::max(index[i], static_cast<double>(region.GetIndex()[i]));
+    index[i] = std::min(index[i], static_cast<double>(region.GetIndex()[i] + region.GetSize()[i] - 1));
+    }
+  return interpolator->EvaluateAtContinuousIndex(index);
+}
+
+template <typename TDeformationField>
+ITK_THREAD_RETURN_TYPE ComputeInverseDeformationFieldThreaded(void* arg)
+{
+  typedef InverseDeformationFieldThreadData<TDeformationField> ThreadDataType;
+  typedef typename ThreadDataType::InterpolatorType InterpolatorType;
+  const unsigned int dimension = TDeformationField::ImageDimension;
+
+  itk::MultiThreader::ThreadInfoStruct* threadInfo = static_cast<itk::MultiThreader::ThreadInfoStruct*>(arg);
+  ThreadDataType* data = static_cast<ThreadDataType*>(threadInfo->UserData);
+
+  for(unsigned int tileId = threadInfo->ThreadID; tileId < data->Tiles.size(); tileId += threadInfo->NumberOfThreads)
+    {
+    itk::ImageRegionIteratorWithIndex<TDeformationField> inverseIterator(data->InverseDeformationField, data->Tiles[tileId]);
+    while(!inverseIterator.IsAtEnd())
+      {
+      // Find the fixed point x that the field takes to this moving point y, i.e. x + u(x) = y, by iterating
+      // x = y - u(x). This converges where the field is a contraction, which holds for smooth landmark fields.
+      typename InterpolatorType::PointType movingPoint;
+      data->InverseDeformationField->TransformIndexToPhysicalPoint(inverseIterator.GetIndex(), movingPoint);
+      typename InterpolatorType::PointType fixedPoint = movingPoint;
+
+      bool converged = false;
+      for(unsigned int iteration = 0; iteration < data->MaximumIterations && !converged; ++iteration)
+        {
+        const typename InterpolatorType::OutputType displacement = EvaluateField(data->Interpolator, fixedPoint);
+        double squaredChange = 0;
+        for(unsigned int i = 0; i < dimension; ++i)
+          {
+          const double next = movingPoint[i] - displacement[i];
+          squaredChange += (next - fixedPoint[i]) * (next - fixedPoint[i]);
+          fixedPoint[i] = next;
+          }
+        converged = squaredChange < data->Tolerance * data->Tolerance;
+        }
+      if(!converged)
+        {
+        data->NumberOfUnconverged[threadInfo->ThreadID]++;
+        }
+
+      typename TDeformationField::PixelType inverseDisplacement;
+      for(unsigned int i = 0; i < dimension; ++i)
+        {
+        inverseDisplacement[i] = static_cast<typename TDeformationField::PixelType::ValueType>(fixedPoint[i] - movingPoint[i]);
+        }
+      inverseIterator.Set(inverseDisplacement);
+      ++inverseIterator;
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+// Compute the inverse of 'deformationField' on the grid of 'movingImage': a field that takes each moving point
+// back to the fixed point that maps onto it. Each pixel is solved by fixed point iteration on the forward field,
+// until it moves less than 'tolerance' pixels (of the smallest spacing), so no second registration is needed.
+template <typename TDeformationField>
+typename TDeformationField::Pointer
+ComputeInverseDeformationField(const TDeformationField* deformationField,
+                               const itk::ImageBase<TDeformationField::ImageDimension>* movingImage,
+                               const unsigned int maximumIterations = 20, const double tolerance = 0.01)
+{
+  typedef InverseDeformationFieldThreadData<TDeformationField> ThreadDataType;
+  typedef typename ThreadDataType::InterpolatorType InterpolatorType;
+
+  typename TDeformationField::Pointer inverseDeformationField = TDeformationField::New();
+  inverseDeformationField->CopyInformation(movingImage);
+  inverseDeformationField->SetRegions(movingImage->GetLargestPossibleRegion());
+  inverseDeformationField->Allocate();
+
+  typename InterpolatorType::Pointer interpolator = InterpolatorType::New();
+  interpolator->SetInputImage(deformationField);
+
+  double smallestSpacing = movingImage->GetSpacing()[0];
+  for(unsigned int i = 1; i < TDeformationField::ImageDimension; ++i)
+    {
+    smallestSpacing = std::min(smallestSpacing, static_cast<double>(movingImage->GetSpacing()[i]));
+    }
+
+  ThreadDataType data;
+  data.Interpolator = interpolator;
+  data.InverseDeformationField = inverseDeformationField;
+  data.Tiles = ComputeTiles<TDeformationField::ImageDimension>(inverseDeformationField->GetLargestPossibleRegion());
+  data.MaximumIterations = maximumIterations;
+  data.Tolerance = tolerance * smallestSpacing;
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(std::min(threader->GetNumberOfThreads(), static_cast<int>(data.Tiles.size())));
+  data.NumberOfUnconverged.resize(threader->GetNumberOfThreads(), 0);
+  threader->SetSingleMethod(ComputeInverseDeformationFieldThreaded<TDeformationField>, &data);
+  threader->SingleMethodExecute();
+
+  unsigned long numberOfUnconverged = 0;
+  for(unsigned int i = 0; i < data.NumberOfUnconverged.size(); ++i)
+    {
+    numberOfUnconverged += data.NumberOfUnconverged[i];
+    }
+  if(numberOfUnconverged > 0)
+    {
+    std::cout << "The inverse field did not converge at " << numberOfUnconverged << " pixels." << std::endl;
+    }
+
+  return inverseDeformationField;
+}
+
+template <typename TDeformationField>
+struct TransformPointsThreadData
+{
+  typedef itk::VectorLinearInterpolateImageFunction<TDeformationField, double> InterpolatorType;
+  typedef std::vector<typename ImageTypes<TDeformationField::ImageDimension>::PointType> PointListType;
+
+  const InterpolatorType* Interpolator;
+  const PointListType* Points;
+  PointListType* TransformedPoints;
+};
+
+template <typename TDeformationField>
+ITK_THREAD_RETURN_TYPE TransformPointsThreaded(void* arg)
+{
+  typedef TransformPointsThreadData<TDeformationField> ThreadDataType;
+
+  itk::MultiThreader::ThreadInfoStruct* threadInfo = static_cast<itk::MultiThreader::ThreadInfoStruct*>(arg);
+  ThreadDataType* data = static_cast<ThreadDataType*>(threadInfo->UserData);
+
+  for(unsigned int pointId = threadInfo->ThreadID; pointId < data->Points->size(); pointId += threadInfo->NumberOfThreads)
+    {
+    const typename ThreadDataType::InterpolatorType::OutputType displacement =
+      EvaluateField(data->Interpolator, (*data->Points)[pointId]);
+    for(unsigned int i = 0; i < TDeformationField::ImageDimension; ++i)
+      {
+      (*data->TransformedPoints)[pointId][i] = (*data->Points)[pointId][i] + displacement[i];
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+// Move a batch of physical points through a deformation field (the forward field, or an inverse one)
+template <typename TDeformationField>
+std::vector<typename ImageTypes<TDeformationField::ImageDimension>::PointType>
+TransformPoints(const TDeformationField* deformationField,
+                const std::vector<typename ImageTypes<TDeformationField::ImageDimension>::PointType>& points)
+{
+  typedef TransformPointsThreadData<TDeformationField> ThreadDataType;
+  typedef typename ThreadDataType::InterpolatorType InterpolatorType;
+
+  typename ThreadDataType::PointListType transformedPoints(points.size());
+  if(points.empty())
+    {
+    return transformedPoints;
+    }
+
+  typename InterpolatorType::Pointer interpolator = InterpolatorType::New();
+  interpolator->SetInputImage(deformationField);
+
+  ThreadDataType data;
+  data.Interpolator = interpolator;
+  data.Points = &points;
+  data.TransformedPoints = &transformedPoints;
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(std::min(threader->GetNumberOfThreads(), static_cast<int>(points.size())));
+  threader->SetSingleMethod(TransformPointsThreaded<TDeformationField>, &data);
+  threader->SingleMethodExecute();
+
+  return transformedPoints;
+}
+
+// Compute the field and warp the moving image through it. If 'deformationFieldOutput' is given, it is set to the
+// field, a PrecisionTypes<TDimension, TPrecision>::DeformationFieldType.
+template <unsigned int TDimension, typename TPrecision>
+typename ImageTypes<TDimension>::FloatVectorImageType::Pointer
+RegisterImage(const typename ImageTypes<TDimension>::FloatVectorImageType* fixedImage,
+              typename ImageTypes<TDimension>::FloatVectorImageType* movingImage,
+              const std::vector<typename ImageTypes<TDimension>::PointType>& fixedLandmarks,
+              const std::vector<typename ImageTypes<TDimension>::PointType>& movingLandmarks,
+              std::vector<typename ImageTypes<TDimension>::DeformationVectorType>* leaveOneOutErrors = NULL,
+              itk::DataObject::Pointer* deformationFieldOutput = NULL)
+{
+  typename PrecisionTypes<TDimension, TPrecision>::DeformationFieldType::Pointer deformationField =
+    ComputeDeformationField<TDimension, TPrecision>(fixedImage, fixedLandmarks, movingLandmarks, leaveOneOutErrors);
+  if(deformationFieldOutput)
+    {
+    *deformationFieldOutput = deformationField.GetPointer();
+    }
+  return WarpImage<TDimension, TPrecision>(movingImage, deformationField, fixedImage);
+}
+
+// The same, with the precision policy chosen at run time. This is the one place that maps a PrecisionPolicyType to
+// its policy; callers that need the field afterwards find its type from the field itself.
+template <unsigned int TDimension>
+typename ImageTypes<TDimension>::FloatVectorImageType::Pointer
+RegisterImage(const typename ImageTypes<TDimension>::FloatVectorImageType* fixedImage,
+              typename ImageTypes<TDimension>::FloatVectorImageType* movingImage,
+              const std::vector<typename ImageTypes<TDimension>::PointType>& fixedLandmarks,
+              const std::vector<typename ImageTypes<TDimension>::PointType>& movingLandmarks,
+              const PrecisionPolicyType precision,
+              std::vector<typename ImageTypes<TDimension>::DeformationVectorType>* leaveOneOutErrors = NULL,
+              itk::DataObject::Pointer* deformationFieldOutput = NULL)
+{
+  switch(precision)
+    {
+    case FloatPrecisionPolicy:
+      return RegisterImage<TDimension, FloatPrecision>(fixedImage, movingImage, fixedLandmarks, movingLandmarks,
+                                                       leaveOneOutErrors, deformationFieldOutput);
+    case MixedPrecisionPolicy:
+      return RegisterImage<TDimension, MixedPrecision>(fixedImage, movingImage, fixedLandmarks, movingLandmarks,
+                                                       leaveOneOutErrors, deformationFieldOutput);
+    default:
+      return RegisterImage<TDimension, DoublePrecision>(fixedImage, movingImage, fixedLandmarks, movingLandmarks,
+                                                        leaveOneOutErrors, deformationFieldOutput);
+    }
+}
+
+} // end namespace
+
+#endif
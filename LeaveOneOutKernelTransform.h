@@ -0,0 +1,116 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef LEAVEONEOUTKERNELTRANSFORM_H
+#define LEAVEONEOUTKERNELTRANSFORM_H
+
+// STL
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// ITK
+#include "itkThinPlateSplineKernelTransform.h"
+
+// VNL
+#include "vnl/algo/vnl_svd.h"
+
+// A thin plate spline that also reports, for each landmark, its leave-one-out error: the difference between its
+// target and where the spline through all the other landmarks would put it. A high error flags a landmark pair
+// that disagrees with the rest.
+// The errors come from the same factorization that solves the system. For the kernel system L w = y, the
+// leave-one-out error of landmark i is w_i / (L^-1)_ii, so no system has to be solved again per landmark.
+template <typename TScalarType, unsigned int NDimensions>
+class LeaveOneOutKernelTransform : public itk::ThinPlateSplineKernelTransform<TScalarType, NDimensions>
+{
+public:
+  typedef LeaveOneOutKernelTransform Self;
+  typedef itk::ThinPlateSplineKernelTransform<TScalarType, NDimensions> Superclass;
+  typedef itk::SmartPointer<Self> Pointer;
+  typedef itk::SmartPointer<const Self> ConstPointer;
+  itkNewMacro(Self);
+  itkTypeMacro(LeaveOneOutKernelTransform, ThinPlateSplineKernelTransform);
+
+  typedef typename Superclass::OutputVectorType OutputVectorType;
+
+  // Use this instead of ComputeWMatrix()
+  void ComputeWMatrixAndLeaveOneOutErrors()
+  {
+    // The same solve as KernelTransform::ComputeWMatrix, keeping the factorization
+    this->ComputeL();
+    this->ComputeY();
+    vnl_svd<TScalarType> svd(this->m_LMatrix, 1e-8);
+    this->m_WMatrix = svd.solve(this->m_YMatrix);
+    this->ReorganizeW();
+
+    this->LeaveOneOutErrors.clear();
+
+    // Removing a landmark must leave enough of them to fit the affine part
+    const unsigned int numberOfLandmarks = this->m_SourceLandmarks->GetNumberOfPoints();
+    if(numberOfLandmarks < NDimensions + 2)
+      {
+      return;
+      }
+
+    // The diagonal of the (pseudo)inverse is sum_k U_ik V_ik / s_k. Only the landmark rows are needed.
+    const vnl_matrix<TScalarType>& U = svd.U();
+    const vnl_matrix<TScalarType>& V = svd.V();
+    std::vector<OutputVectorType> errors(numberOfLandmarks);
+    for(unsigned int landmarkId = 0; landmarkId < numberOfLandmarks; ++landmarkId)
+      {
+      for(unsigned int dimension = 0; dimension < NDimensions; ++dimension)
+        {
+        const unsigned int row = landmarkId * NDimensions + dimension;
+        TScalarType inverseDiagonal = 0;
+        TScalarType magnitude = 0;
+        for(unsigned int k = 0; k < svd.rank(); ++k)
+          {
+          const TScalarType term = U(row, k) * V(row, k) * svd.Winverse()[k];
+          inverseDiagonal += term;
+          magnitude += std::fabs(term);
+          }
+
+        // Landmarks that the system cannot do without (e.g. coincident or degenerate configurations). The sum is
+        // only known to within its rounding error, which scales with the precision and the size of its terms.
+        if(std::fabs(inverseDiagonal) <= svd.rank() * std::numeric_limits<TScalarType>::epsilon() * magnitude)
+          {
+          return;
+          }
+        errors[landmarkId][dimension] = this->m_DMatrix(dimension, landmarkId) / inverseDiagonal;
+        }
+      }
+    this->LeaveOneOutErrors = errors;
+  }
+
+  // One error per landmark, in physical units. Empty if there are too few landmarks, or they are degenerate.
+  const std::vector<OutputVectorType>& GetLeaveOneOutErrors() const
+  {
+    return this->LeaveOneOutErrors;
+  }
+
+protected:
+  LeaveOneOutKernelTransform() {}
+
+private:
+  LeaveOneOutKernelTransform(const Self&); // Not implemented
+  void operator=(const Self&); // Not implemented
+
+  std::vector<OutputVectorType> LeaveOneOutErrors;
+};
+
+#endif
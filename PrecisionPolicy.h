@@ -0,0 +1,93 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef PRECISIONPOLICY_H
+#define PRECISIONPOLICY_H
+
+// STL
+#include <string>
+
+// ITK
+#include "itkImage.h"
+#include "itkVector.h"
+
+// The precision policies of the registration path. SolveType is used to solve the landmark system.
+// FieldValueType is used to store the deformation field, and by the field transform and the resampler
+// that interpolate it. A float field takes half the memory and bandwidth of a double one.
+struct DoublePrecision
+{
+  typedef double SolveType;
+  typedef double FieldValueType;
+};
+
+struct FloatPrecision
+{
+  typedef float SolveType;
+  typedef float FieldValueType;
+};
+
+// Solve in double, store and interpolate the field in float
+struct MixedPrecision
+{
+  typedef double SolveType;
+  typedef float FieldValueType;
+};
+
+template <unsigned int TDimension, typename TPrecision>
+struct PrecisionTypes
+{
+  typedef itk::Vector<typename TPrecision::FieldValueType, TDimension> DeformationVectorType;
+  typedef itk::Image<DeformationVectorType, TDimension> DeformationFieldType;
+};
+
+// For choosing a policy at run time
+enum PrecisionPolicyType {DoublePrecisionPolicy, FloatPrecisionPolicy, MixedPrecisionPolicy};
+
+// The policy used when none is chosen, set at build time with IIR_DEFAULT_PRECISION
+#ifndef IIR_DEFAULT_PRECISION
+#define IIR_DEFAULT_PRECISION DoublePrecisionPolicy
+#endif
+
+inline const char* GetPrecisionPolicyName(const PrecisionPolicyType policy)
+{
+  switch(policy)
+    {
+    case FloatPrecisionPolicy:
+      return "float";
+    case MixedPrecisionPolicy:
+      return "mixed";
+    default:
+      return "double";
+    }
+}
+
+// Returns false if the name is not one of "double", "float" or "mixed"
+inline bool ParsePrecisionPolicy(const std::string& name, PrecisionPolicyType& policy)
+{
+  for(int i = DoublePrecisionPolicy; i <= MixedPrecisionPolicy; ++i)
+    {
+    if(name == GetPrecisionPolicyName(static_cast<PrecisionPolicyType>(i)))
+      {
+      policy = static_cast<PrecisionPolicyType>(i);
+      return true;
+      }
+    }
+  return false;
+}
+
+#endif
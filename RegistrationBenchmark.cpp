@@ -0,0 +1,223 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+// Times the landmark registration core under each precision policy on a synthetic image, and reports how far
+// the float and mixed results are from the double ones.
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// ITK
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+#include "itkTimeProbe.h"
+
+// Custom
+#include "LandmarkRegistration.h"
+#include "PrecisionPolicy.h"
+#include "Types.h"
+
+typedef std::vector<ImageTypes<2>::PointType> PointListType;
+
+// A smooth three component pattern, so interpolation differences show up in every pixel
+static FloatVectorImageType::Pointer CreateImage(const unsigned int size)
+{
+  FloatVectorImageType::IndexType corner;
+  corner.Fill(0);
+  FloatVectorImageType::SizeType imageSize;
+  imageSize.Fill(size);
+  FloatVectorImageType::RegionType region(corner, imageSize);
+
+  FloatVectorImageType::Pointer image = FloatVectorImageType::New();
+  image->SetRegions(region);
+  image->SetNumberOfComponentsPerPixel(3);
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<FloatVectorImageType> imageIterator(image, region);
+  FloatVectorImageType::PixelType pixel(3);
+  while(!imageIterator.IsAtEnd())
+    {
+    const double x = imageIterator.GetIndex()[0];
+    const double y = imageIterator.GetIndex()[1];
+    pixel[0] = 127.5 * (1 + std::sin(x / 7.0) * std::cos(y / 11.0));
+    pixel[1] = 127.5 * (1 + std::sin((x + y) / 13.0));
+    pixel[2] = 255.0 * x / size;
+    imageIterator.Set(pixel);
+    ++imageIterator;
+    }
+
+  return image;
+}
+
+// Random fixed landmarks, and moving landmarks displaced by a smooth warp plus a few pixels of noise
+static void CreateLandmarks(const unsigned int size, const unsigned int numberOfLandmarks,
+                            PointListType& fixedLandmarks, PointListType& movingLandmarks)
+{
+  typedef itk::Statistics::MersenneTwisterRandomVariateGenerator GeneratorType;
+  GeneratorType::Pointer generator = GeneratorType::New();
+  generator->Initialize(76926294);
+
+  fixedLandmarks.resize(numberOfLandmarks);
+  movingLandmarks.resize(numberOfLandmarks);
+  for(unsigned int i = 0; i < numberOfLandmarks; ++i)
+    {
+    for(unsigned int j = 0; j < 2; ++j)
+      {
+      fixedLandmarks[i][j] = generator->GetUniformVariate(0, size - 1);
+      }
+    movingLandmarks[i][0] = fixedLandmarks[i][0] + 0.02 * size * std::sin(fixedLandmarks[i][1] / size * 6.28)
+                            + generator->GetUniformVariate(-2, 2);
+    movingLandmarks[i][1] = fixedLandmarks[i][1] + 0.02 * size * std::cos(fixedLandmarks[i][0] / size * 6.28)
+                            + generator->GetUniformVariate(-2, 2);
+    }
+}
+
+// The largest and the mean per pixel difference of two images with the same grid. For vector pixels, the
+// difference is the Euclidean norm over the components.
+template <typename TImageA, typename TImageB>
+static void ComputeDifference(const TImageA* imageA, const TImageB* imageB, double& maximum, double& mean)
+{
+  itk::ImageRegionConstIterator<TImageA> iteratorA(imageA, imageA->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<TImageB> iteratorB(imageB, imageB->GetLargestPossibleRegion());
+
+  maximum = 0;
+  double sum = 0;
+  unsigned long numberOfPixels = 0;
+  while(!iteratorA.IsAtEnd())
+    {
+    double squaredDifference = 0;
+    for(unsigned int i = 0; i < iteratorA.Get().Size(); ++i)
+      {
+      const double difference = static_cast<double>(iteratorA.Get()[i]) - static_cast<double>(iteratorB.Get()[i]);
+      squaredDifference += difference * difference;
+      }
+    const double difference = std::sqrt(squaredDifference);
+    maximum = std::max(maximum, difference);
+    sum += difference;
+    ++numberOfPixels;
+    ++iteratorA;
+    ++iteratorB;
+    }
+  mean = numberOfPixels > 0 ? sum / numberOfPixels : 0;
+}
+
+// Run the registration 'numberOfRuns' times under TPrecision and print the mean times. The field and warped
+// image of the last run are compared against the reference ones. With no reference (the double run), the
+// results become the reference.
+template <typename TPrecision>
+static void Benchmark(const PrecisionPolicyType policy, FloatVectorImageType* fixedImage, FloatVectorImageType* movingImage,
+                      const PointListType& fixedLandmarks, const PointListType& movingLandmarks,
+                      const unsigned int numberOfRuns,
+                      DeformationFieldType::Pointer& referenceField, FloatVectorImageType::Pointer& referenceImage)
+{
+  typedef typename PrecisionTypes<2, TPrecision>::DeformationFieldType PolicyDeformationFieldType;
+
+  itk::TimeProbe fieldProbe;
+  itk::TimeProbe warpProbe;
+  typename PolicyDeformationFieldType::Pointer deformationField;
+  FloatVectorImageType::Pointer warpedImage;
+  for(unsigned int run = 0; run < numberOfRuns; ++run)
+    {
+    fieldProbe.Start();
+    deformationField = LandmarkRegistration::ComputeDeformationField<2, TPrecision>(fixedImage, fixedLandmarks,
+                                                                                   movingLandmarks);
+    fieldProbe.Stop();
+
+    warpProbe.Start();
+    warpedImage = LandmarkRegistration::WarpImage<2, TPrecision>(movingImage, deformationField, fixedImage);
+    warpProbe.Stop();
+    }
+
+  const unsigned long long fieldBytes = static_cast<unsigned long long>(
+    deformationField->GetLargestPossibleRegion().GetNumberOfPixels()) * sizeof(typename PolicyDeformationFieldType::PixelType);
+
+  std::cout << std::setw(8) << GetPrecisionPolicyName(policy)
+            << std::setw(12) << fieldProbe.GetMean()
+            << std::setw(12) << warpProbe.GetMean()
+            << std::setw(12) << fieldBytes / (1024 * 1024);
+
+  if(!referenceField)
+    {
+    // Only the double policy runs without a reference, and its field has the reference type
+    referenceField = dynamic_cast<DeformationFieldType*>(deformationField.GetPointer());
+    referenceImage = warpedImage;
+    std::cout << std::setw(14) << "reference" << std::endl;
+    return;
+    }
+
+  double maximumFieldError = 0;
+  double meanFieldError = 0;
+  ComputeDifference(referenceField.GetPointer(), deformationField.GetPointer(), maximumFieldError, meanFieldError);
+  double maximumImageError = 0;
+  double meanImageError = 0;
+  ComputeDifference(referenceImage.GetPointer(), warpedImage.GetPointer(), maximumImageError, meanImageError);
+
+  std::cout << std::setw(14) << maximumFieldError
+            << std::setw(14) << meanFieldError
+            << std::setw(14) << maximumImageError
+            << std::setw(14) << meanImageError << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  // Usage: RegistrationBenchmark [imageSize [numberOfLandmarks [numberOfRuns]]]
+  if(argc > 4)
+    {
+    std::cerr << "Usage: " << argv[0] << " [imageSize [numberOfLandmarks [numberOfRuns]]]" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const unsigned int size = argc > 1 ? atoi(argv[1]) : 1024;
+  const unsigned int numberOfLandmarks = argc > 2 ? atoi(argv[2]) : 50;
+  const unsigned int numberOfRuns = argc > 3 ? atoi(argv[3]) : 3;
+  if(size < 2 || numberOfLandmarks < 3 || numberOfRuns < 1)
+    {
+    std::cerr << "The image size must be at least 2, with at least 3 landmarks and 1 run." << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  FloatVectorImageType::Pointer fixedImage = CreateImage(size);
+  FloatVectorImageType::Pointer movingImage = CreateImage(size);
+  PointListType fixedLandmarks;
+  PointListType movingLandmarks;
+  CreateLandmarks(size, numberOfLandmarks, fixedLandmarks, movingLandmarks);
+
+  std::cout << size << "x" << size << " image, " << numberOfLandmarks << " landmarks, mean of "
+            << numberOfRuns << " runs. Times in seconds, field errors in pixels, image errors in intensity." << std::endl;
+  std::cout << std::setw(8) << "policy" << std::setw(12) << "field" << std::setw(12) << "warp"
+            << std::setw(12) << "field MB" << std::setw(14) << "max field err" << std::setw(14) << "mean field err"
+            << std::setw(14) << "max image err" << std::setw(14) << "mean image err" << std::endl;
+
+  // The double policy goes first, as the reference
+  DeformationFieldType::Pointer referenceField;
+  FloatVectorImageType::Pointer referenceImage;
+  Benchmark<DoublePrecision>(DoublePrecisionPolicy, fixedImage, movingImage, fixedLandmarks, movingLandmarks,
+                             numberOfRuns, referenceField, referenceImage);
+  Benchmark<FloatPrecision>(FloatPrecisionPolicy, fixedImage, movingImage, fixedLandmarks, movingLandmarks,
+                            numberOfRuns, referenceField, referenceImage);
+  Benchmark<MixedPrecision>(MixedPrecisionPolicy, fixedImage, movingImage, fixedLandmarks, movingLandmarks,
+                            numberOfRuns, referenceField, referenceImage);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,325 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+// A minimal client of RegistrationDaemon, for testing: registers two 2D images with landmark files and writes the
+// result. The fixed image is first sent by name only, and its pixels only if the daemon does not have it resident.
+
+// STL
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// POSIX
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// ITK
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkImageIOFactory.h"
+
+// Custom
+#include "Helpers.h"
+#include "PrecisionPolicy.h"
+#include "RegistrationProtocol.h"
+#include "Types.h"
+
+using namespace RegistrationProtocol;
+
+// A shared memory object created by this client, removed when it goes out of scope
+struct SharedMemory
+{
+  SharedMemory() : Address(NULL), Length(0) {}
+  ~SharedMemory()
+  {
+    if(this->Address)
+      {
+      munmap(this->Address, this->Length);
+      shm_unlink(this->Name.c_str());
+      }
+  }
+
+  bool Create(const std::string& name, const std::size_t length)
+  {
+    this->Name = name;
+    this->Length = length;
+    this->Address = MapSharedMemory(name, length, true);
+    return this->Address != NULL;
+  }
+
+  std::string Name;
+  void* Address;
+  std::size_t Length;
+};
+
+// Describe an image from its file header only, without reading its pixels
+static bool ReadDescription(const std::string& fileName, ImageDescription& description)
+{
+  itk::ImageIOBase::Pointer imageIO = itk::ImageIOFactory::CreateImageIO(fileName.c_str(), itk::ImageIOFactory::ReadMode);
+  if(!imageIO)
+    {
+    std::cerr << "Could not read " << fileName << std::endl;
+    return false;
+    }
+  imageIO->SetFileName(fileName);
+  try
+    {
+    imageIO->ReadImageInformation();
+    }
+  catch(itk::ExceptionObject& error)
+    {
+    std::cerr << "Could not read " << fileName << ": " << error << std::endl;
+    return false;
+    }
+
+  memset(&description, 0, sizeof(description));
+  for(unsigned int i = 0; i < MaximumDimension; ++i)
+    {
+    description.Size[i] = i < imageIO->GetNumberOfDimensions() ? imageIO->GetDimensions(i) : 1;
+    description.Spacing[i] = i < imageIO->GetNumberOfDimensions() ? imageIO->GetSpacing(i) : 1;
+    description.Origin[i] = i < imageIO->GetNumberOfDimensions() ? imageIO->GetOrigin(i) : 0;
+    }
+  description.NumberOfComponents = imageIO->GetNumberOfComponents();
+  return true;
+}
+
+// Read an image into a new shared memory object
+static bool ReadIntoSharedMemory(const std::string& fileName, const std::string& name, ImageDescription& description,
+                                 SharedMemory& sharedMemory)
+{
+  typedef itk::ImageFileReader<FloatVectorImageType> ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(fileName);
+  try
+    {
+    reader->Update();
+    }
+  catch(itk::ExceptionObject& error)
+    {
+    std::cerr << "Could not read " << fileName << ": " << error << std::endl;
+    return false;
+    }
+
+  FloatVectorImageType* image = reader->GetOutput();
+  memset(&description, 0, sizeof(description));
+  for(unsigned int i = 0; i < MaximumDimension; ++i)
+    {
+    description.Size[i] = i < 2 ? image->GetLargestPossibleRegion().GetSize()[i] : 1;
+    description.Spacing[i] = i < 2 ? image->GetSpacing()[i] : 1;
+    description.Origin[i] = i < 2 ? image->GetOrigin()[i] : 0;
+    }
+  description.NumberOfComponents = image->GetNumberOfComponentsPerPixel();
+
+  const std::size_t length = GetBufferSize(description, 2);
+  if(length == 0 || !sharedMemory.Create(name, length))
+    {
+    std::cerr << "Could not put " << fileName << " in shared memory." << std::endl;
+    return false;
+    }
+  memcpy(sharedMemory.Address, image->GetBufferPointer(), sharedMemory.Length);
+  SetName(description.SharedMemoryName, name);
+  return true;
+}
+
+// Send a job and wait for its reply. Returns false if the daemon could not be reached.
+static bool RunJob(const std::string& socketPath, const JobRequest& request, const std::vector<double>& landmarks,
+                   JobReply& reply, std::vector<double>& leaveOneOutErrors)
+{
+  const int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+  if(connection < 0 || connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+    std::cerr << "Could not connect to the daemon at " << socketPath << ": " << strerror(errno) << std::endl;
+    if(connection >= 0)
+      {
+      close(connection);
+      }
+    return false;
+    }
+
+  bool succeeded = Send(connection, &request, sizeof(request)) &&
+                   Send(connection, &landmarks[0], landmarks.size() * sizeof(double)) &&
+                   Receive(connection, &reply, sizeof(reply));
+  if(succeeded)
+    {
+    leaveOneOutErrors.resize(reply.NumberOfLandmarks * 2);
+    succeeded = leaveOneOutErrors.empty() ||
+                Receive(connection, &leaveOneOutErrors[0], leaveOneOutErrors.size() * sizeof(double));
+    }
+  close(connection);
+
+  if(!succeeded)
+    {
+    std::cerr << "The connection to the daemon failed." << std::endl;
+    }
+  return succeeded;
+}
+
+int main(int argc, char** argv)
+{
+  // Usage: RegistrationClient fixedImage movingImage fixedLandmarks movingLandmarks outputImage [precision [socketPath]]
+  if(argc < 6 || argc > 8)
+    {
+    std::cerr << "Usage: " << argv[0] << " fixedImage movingImage fixedLandmarks movingLandmarks outputImage"
+              << " [double|float|mixed [socketPath]]" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  PrecisionPolicyType precision = IIR_DEFAULT_PRECISION;
+  if(argc > 6 && !ParsePrecisionPolicy(argv[6], precision))
+    {
+    std::cerr << "Unknown precision " << argv[6] << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string socketPath = argc > 7 ? argv[7] : DefaultSocketPath;
+
+  JobRequest request;
+  memset(&request, 0, sizeof(request));
+  request.Version = Version;
+  request.Dimension = 2;
+  request.Precision = precision;
+  SetName(request.FixedImageKey, argv[1]);
+  if(!ReadDescription(argv[1], request.FixedImage))
+    {
+    return EXIT_FAILURE;
+    }
+
+  // The daemon only accepts shared memory objects named with this client's prefix
+  const std::string prefix = GetClientPrefix(getpid());
+
+  SharedMemory movingMemory;
+  if(!ReadIntoSharedMemory(argv[2], prefix + "moving", request.MovingImage, movingMemory))
+    {
+    return EXIT_FAILURE;
+    }
+
+  // The output is on the fixed grid, with the moving components
+  ImageDescription outputDescription = request.FixedImage;
+  outputDescription.NumberOfComponents = request.MovingImage.NumberOfComponents;
+  SharedMemory outputMemory;
+  const std::size_t outputLength = GetBufferSize(outputDescription, 2);
+  if(outputLength == 0 || !outputMemory.Create(prefix + "output", outputLength))
+    {
+    std::cerr << "Could not create the output in shared memory." << std::endl;
+    return EXIT_FAILURE;
+    }
+  SetName(request.OutputSharedMemoryName, outputMemory.Name);
+
+  // The landmark files have pixel positions, the daemon takes physical points
+  std::vector<ContinuousIndexType> fixedIndices = Helpers::ReadLandmarks(argv[3]);
+  std::vector<ContinuousIndexType> movingIndices = Helpers::ReadLandmarks(argv[4]);
+  if(fixedIndices.empty() || fixedIndices.size() != movingIndices.size())
+    {
+    std::cerr << "The landmark files must have the same, non-zero, number of landmarks." << std::endl;
+    return EXIT_FAILURE;
+    }
+  request.NumberOfLandmarks = fixedIndices.size();
+  std::vector<double> landmarks;
+  for(unsigned int i = 0; i < fixedIndices.size(); ++i)
+    {
+    for(unsigned int j = 0; j < 2; ++j)
+      {
+      landmarks.push_back(request.FixedImage.Origin[j] + fixedIndices[i][j] * request.FixedImage.Spacing[j]);
+      }
+    }
+  for(unsigned int i = 0; i < movingIndices.size(); ++i)
+    {
+    for(unsigned int j = 0; j < 2; ++j)
+      {
+      landmarks.push_back(request.MovingImage.Origin[j] + movingIndices[i][j] * request.MovingImage.Spacing[j]);
+      }
+    }
+
+  JobReply reply;
+  std::vector<double> leaveOneOutErrors;
+  if(!RunJob(socketPath, request, landmarks, reply, leaveOneOutErrors))
+    {
+    return EXIT_FAILURE;
+    }
+
+  // The daemon did not have the fixed image yet, so send its pixels
+  SharedMemory fixedMemory;
+  if(reply.Status == UnknownFixedImage)
+    {
+    if(!ReadIntoSharedMemory(argv[1], prefix + "fixed", request.FixedImage, fixedMemory) ||
+       !RunJob(socketPath, request, landmarks, reply, leaveOneOutErrors))
+      {
+      return EXIT_FAILURE;
+      }
+    }
+
+  reply.Message[MaximumNameLength - 1] = '\0';
+  if(reply.Status != JobSucceeded)
+    {
+    std::cerr << "The registration failed: " << reply.Message << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << reply.Message << std::endl;
+
+  for(unsigned int i = 0; i < leaveOneOutErrors.size() / 2; ++i)
+    {
+    std::cout << "Leave-one-out error of landmark " << i << ": "
+              << std::sqrt(leaveOneOutErrors[2 * i] * leaveOneOutErrors[2 * i] +
+                           leaveOneOutErrors[2 * i + 1] * leaveOneOutErrors[2 * i + 1]) << std::endl;
+    }
+
+  // Write the result straight from the shared memory
+  FloatVectorImageType::RegionType region;
+  FloatVectorImageType::SpacingType spacing;
+  FloatVectorImageType::PointType origin;
+  for(unsigned int i = 0; i < 2; ++i)
+    {
+    region.SetIndex(i, 0);
+    region.SetSize(i, outputDescription.Size[i]);
+    spacing[i] = outputDescription.Spacing[i];
+    origin[i] = outputDescription.Origin[i];
+    }
+  FloatVectorImageType::Pointer output = FloatVectorImageType::New();
+  output->SetRegions(region);
+  output->SetSpacing(spacing);
+  output->SetOrigin(origin);
+  output->SetNumberOfComponentsPerPixel(outputDescription.NumberOfComponents);
+  output->GetPixelContainer()->SetImportPointer(static_cast<float*>(outputMemory.Address),
+                                                region.GetNumberOfPixels() * outputDescription.NumberOfComponents,
+                                                false);
+
+  typedef itk::ImageFileWriter<FloatVectorImageType> WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetFileName(argv[5]);
+  writer->SetInput(output);
+  try
+    {
+    writer->Update();
+    }
+  catch(itk::ExceptionObject& error)
+    {
+    std::cerr << "Could not write " << argv[5] << ": " << error << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
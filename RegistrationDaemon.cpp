@@ -0,0 +1,81 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+// STL
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+// POSIX
+#include <signal.h>
+
+// ITK
+#include "itkMultiThreader.h"
+
+// Custom
+#include "RegistrationServer.h"
+
+static RegistrationServer* Server = NULL;
+
+static void StopServer(int)
+{
+  if(Server)
+    {
+    Server->Stop();
+    }
+}
+
+int main(int argc, char** argv)
+{
+  // Usage: RegistrationDaemon [socketPath [numberOfWorkers [maximumNumberOfFixedImages]]]
+  if(argc > 4)
+    {
+    std::cerr << "Usage: " << argv[0] << " [socketPath [numberOfWorkers [maximumNumberOfFixedImages]]]" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const unsigned int numberOfWorkers = argc > 2 ? atoi(argv[2]) : 2;
+
+  // Each job is multithreaded itself, so the workers share the cores between them
+  itk::MultiThreader::SetGlobalDefaultNumberOfThreads(
+    std::max(1, itk::MultiThreader::GetGlobalDefaultNumberOfThreads() / static_cast<int>(std::max(numberOfWorkers, 1u))));
+
+  RegistrationServer server;
+  if(argc > 1)
+    {
+    server.SetSocketPath(argv[1]);
+    }
+  server.SetNumberOfWorkers(numberOfWorkers);
+  if(argc > 3)
+    {
+    server.SetMaximumNumberOfFixedImages(atoi(argv[3]));
+    }
+
+  // No SA_RESTART, so that the signal interrupts accept()
+  Server = &server;
+  struct sigaction action;
+  action.sa_handler = StopServer;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = 0;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  const bool succeeded = server.Run();
+  Server = NULL;
+  return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,157 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "RegistrationProtocol.h"
+
+// STL
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace RegistrationProtocol
+{
+
+std::size_t GetBufferSize(const ImageDescription& description, const unsigned int dimension)
+{
+  const std::size_t maximumSize = std::numeric_limits<std::size_t>::max();
+  if(description.NumberOfComponents > maximumSize / sizeof(float))
+    {
+    return 0;
+    }
+  std::size_t size = description.NumberOfComponents * sizeof(float);
+  for(unsigned int i = 0; i < dimension && i < MaximumDimension; ++i)
+    {
+    if(description.Size[i] != 0 && size > maximumSize / description.Size[i])
+      {
+      return 0;
+      }
+    size *= description.Size[i];
+    }
+  return size;
+}
+
+std::string GetClientPrefix(const int processId)
+{
+  std::stringstream ss;
+  ss << "/iir-" << processId << "-";
+  return ss.str();
+}
+
+bool SetName(char* name, const std::string& value)
+{
+  strncpy(name, value.c_str(), MaximumNameLength - 1);
+  name[MaximumNameLength - 1] = '\0';
+  return value.size() < MaximumNameLength;
+}
+
+bool Send(const int socket, const void* buffer, const std::size_t length)
+{
+  const char* data = static_cast<const char*>(buffer);
+  std::size_t sent = 0;
+  while(sent < length)
+    {
+    const ssize_t result = send(socket, data + sent, length - sent, MSG_NOSIGNAL);
+    if(result < 0 && errno == EINTR)
+      {
+      continue;
+      }
+    if(result <= 0)
+      {
+      return false;
+      }
+    sent += result;
+    }
+  return true;
+}
+
+bool Receive(const int socket, void* buffer, const std::size_t length)
+{
+  char* data = static_cast<char*>(buffer);
+  std::size_t received = 0;
+  while(received < length)
+    {
+    const ssize_t result = recv(socket, data + received, length - received, 0);
+    if(result < 0 && errno == EINTR)
+      {
+      continue;
+      }
+    if(result <= 0)
+      {
+      return false;
+      }
+    received += result;
+    }
+  return true;
+}
+
+void* MapSharedMemory(const std::string& name, const std::size_t length, const bool create)
+{
+  const int descriptor = shm_open(name.c_str(), create ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR, 0600);
+  if(descriptor < 0)
+    {
+    std::cerr << "Could not open shared memory " << name << ": " << strerror(errno) << std::endl;
+    return NULL;
+    }
+
+  if(create)
+    {
+    if(ftruncate(descriptor, length) != 0)
+      {
+      std::cerr << "Could not size shared memory " << name << ": " << strerror(errno) << std::endl;
+      close(descriptor);
+      shm_unlink(name.c_str());
+      return NULL;
+      }
+    }
+  else
+    {
+    // Never map past the end of an object the other side made too small
+    struct stat status;
+    if(fstat(descriptor, &status) != 0 || static_cast<std::size_t>(status.st_size) < length)
+      {
+      std::cerr << "Shared memory " << name << " is smaller than the " << length << " bytes expected." << std::endl;
+      close(descriptor);
+      return NULL;
+      }
+    }
+
+  void* address = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+  // The mapping stays valid after the descriptor is closed
+  close(descriptor);
+  if(address == MAP_FAILED)
+    {
+    std::cerr << "Could not map shared memory " << name << ": " << strerror(errno) << std::endl;
+    if(create)
+      {
+      shm_unlink(name.c_str());
+      }
+    return NULL;
+    }
+  return address;
+}
+
+} // end namespace
@@ -0,0 +1,101 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef REGISTRATIONPROTOCOL_H
+#define REGISTRATIONPROTOCOL_H
+
+// STL
+#include <cstddef>
+#include <string>
+
+// The messages between the registration daemon and its clients, on the same host. A client connects to the daemon's
+// Unix domain socket, sends one JobRequest followed by the landmarks, and receives one JobReply followed by the
+// leave-one-out errors. Pixels never go through the socket: they are in POSIX shared memory objects that the client
+// creates, named in the request. The names must start with the client's prefix (see GetClientPrefix), so a client
+// can only have the daemon read or write its own objects. Pixels are floats with interleaved components, x fastest,
+// as in itk::VectorImage. The daemon reads the moving pixels in place and writes the output in place; only fixed
+// images are copied, since they stay resident.
+namespace RegistrationProtocol
+{
+
+static const unsigned int Version = 1;
+static const unsigned int MaximumNameLength = 128;
+static const unsigned int MaximumDimension = 3;
+static const unsigned int MaximumNumberOfLandmarks = 4096;
+static const char* const DefaultSocketPath = "/tmp/InteractiveImageRegistration.sock";
+
+struct ImageDescription
+{
+  char SharedMemoryName[MaximumNameLength]; // e.g. "/iir-1234-moving"
+  unsigned int Size[MaximumDimension]; // Unused axes are 1
+  double Spacing[MaximumDimension];
+  double Origin[MaximumDimension];
+  unsigned int NumberOfComponents;
+};
+
+struct JobRequest
+{
+  unsigned int Version;
+  unsigned int Dimension; // 2 or 3
+
+  // Fixed images stay resident in the daemon under this key (e.g. the file name). The daemon keeps its own copy of
+  // the pixels, so the client may change or remove the shared memory object once the job is done. If the daemon has
+  // the key, FixedImage.SharedMemoryName may be empty and the pixels are not read again.
+  char FixedImageKey[MaximumNameLength];
+  ImageDescription FixedImage;
+  ImageDescription MovingImage;
+
+  // Created by the client, on the grid of the fixed image with the components of the moving image. The daemon
+  // writes the warped pixels directly into it; its contents are undefined if the job fails.
+  char OutputSharedMemoryName[MaximumNameLength];
+
+  unsigned int Precision; // A PrecisionPolicyType
+  unsigned int NumberOfLandmarks;
+  // Followed by NumberOfLandmarks * Dimension doubles of fixed physical points, then as many of moving ones
+};
+
+enum JobStatus {JobSucceeded, JobFailed, UnknownFixedImage};
+
+struct JobReply
+{
+  unsigned int Status; // A JobStatus
+  char Message[MaximumNameLength];
+  unsigned int NumberOfLandmarks; // Zero if the leave-one-out errors are not available
+  // Followed by NumberOfLandmarks * Dimension doubles of leave-one-out errors, in physical units
+};
+
+// The number of bytes of the pixels of an image. Zero if that does not fit in a size_t.
+std::size_t GetBufferSize(const ImageDescription& description, const unsigned int dimension);
+
+// The prefix of the names of the shared memory objects of the client with this process id, e.g. "/iir-1234-"
+std::string GetClientPrefix(const int processId);
+
+// Copy a string into a fixed size name (or message), always terminated. Returns false if it had to be truncated.
+bool SetName(char* name, const std::string& value);
+
+// Blocking reads and writes of exactly 'length' bytes. They return false if the connection fails or closes.
+bool Send(const int socket, const void* buffer, const std::size_t length);
+bool Receive(const int socket, void* buffer, const std::size_t length);
+
+// Map a shared memory object of at least 'length' bytes, creating it (with that size) if 'create' is set.
+// Returns NULL on failure. Unmap with munmap(), and remove the object with shm_unlink() when done.
+void* MapSharedMemory(const std::string& name, const std::size_t length, const bool create);
+
+} // end namespace
+
+#endif
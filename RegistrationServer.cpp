@@ -0,0 +1,641 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "RegistrationServer.h"
+
+// STL
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+// POSIX
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Custom
+#include "LandmarkRegistration.h"
+#include "PrecisionPolicy.h"
+#include "Types.h"
+
+using namespace RegistrationProtocol;
+
+// A client that sends or reads nothing for this many seconds is dropped, so it can't hold a worker forever
+static const int ConnectionTimeout = 30;
+
+// Set up an image with the grid of 'description', without pixels. Returns the number of pixels.
+template <typename TImage>
+static unsigned long SetImageInformation(const ImageDescription& description, TImage* image)
+{
+  const unsigned int dimension = TImage::ImageDimension;
+
+  typename TImage::RegionType region;
+  typename TImage::SpacingType spacing;
+  typename TImage::PointType origin;
+  unsigned long numberOfPixels = 1;
+  for(unsigned int i = 0; i < dimension; ++i)
+    {
+    region.SetIndex(i, 0);
+    region.SetSize(i, description.Size[i]);
+    spacing[i] = description.Spacing[i];
+    origin[i] = description.Origin[i];
+    numberOfPixels *= description.Size[i];
+    }
+
+  image->SetRegions(region);
+  image->SetSpacing(spacing);
+  image->SetOrigin(origin);
+  image->SetNumberOfComponentsPerPixel(description.NumberOfComponents);
+  return numberOfPixels;
+}
+
+// Wrap pixels that are already in memory as an image, without copying them. The image does not own the pixels.
+template <typename TImage>
+static typename TImage::Pointer ImportImage(const ImageDescription& description, float* pixels)
+{
+  typename TImage::Pointer image = TImage::New();
+  const unsigned long numberOfPixels = SetImageInformation(description, image.GetPointer());
+  image->GetPixelContainer()->SetImportPointer(pixels, numberOfPixels * description.NumberOfComponents, false);
+  return image;
+}
+
+// Copy pixels into a new image that owns them
+template <typename TImage>
+static typename TImage::Pointer CopyImage(const ImageDescription& description, const float* pixels)
+{
+  typename TImage::Pointer image = TImage::New();
+  const unsigned long numberOfPixels = SetImageInformation(description, image.GetPointer());
+  image->Allocate();
+  memcpy(image->GetBufferPointer(), pixels, numberOfPixels * description.NumberOfComponents * sizeof(float));
+  return image;
+}
+
+static bool HasPrefix(const std::string& name, const std::string& prefix)
+{
+  return name.compare(0, prefix.size(), prefix) == 0;
+}
+
+static bool IsValid(const ImageDescription& description, const unsigned int dimension)
+{
+  // A zero buffer size also catches sizes that would overflow
+  if(description.NumberOfComponents == 0 || GetBufferSize(description, dimension) == 0)
+    {
+    return false;
+    }
+  for(unsigned int i = 0; i < dimension; ++i)
+    {
+    if(description.Size[i] == 0 || description.Spacing[i] <= 0)
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+// The precision policy of a job, in a form the registration core can be instantiated with. The warped image is
+// written into 'outputPixels'.
+template <unsigned int TDimension, typename TPrecision>
+static void RegisterWithPrecision(typename ImageTypes<TDimension>::FloatVectorImageType* fixedImage,
+                                  typename ImageTypes<TDimension>::FloatVectorImageType* movingImage,
+                                  const std::vector<typename ImageTypes<TDimension>::PointType>& fixedLandmarks,
+                                  const std::vector<typename ImageTypes<TDimension>::PointType>& movingLandmarks,
+                                  float* outputPixels, const std::size_t outputLength,
+                                  itk::DataObject::Pointer& deformationField, std::vector<double>& leaveOneOutErrors)
+{
+  typedef typename PrecisionTypes<TDimension, TPrecision>::DeformationFieldType DeformationFieldType;
+
+  // A field passed in is the cached one for these landmarks
+  typename DeformationFieldType::Pointer field = dynamic_cast<DeformationFieldType*>(deformationField.GetPointer());
+  if(!field)
+    {
+    std::vector<typename ImageTypes<TDimension>::DeformationVectorType> errors;
+    field = LandmarkRegistration::ComputeDeformationField<TDimension, TPrecision>(fixedImage, fixedLandmarks,
+                                                                                 movingLandmarks, &errors);
+    deformationField = field.GetPointer();
+
+    leaveOneOutErrors.clear();
+    for(unsigned int i = 0; i < errors.size(); ++i)
+      {
+      for(unsigned int j = 0; j < TDimension; ++j)
+        {
+        leaveOneOutErrors.push_back(errors[i][j]);
+        }
+      }
+    }
+
+  LandmarkRegistration::WarpImage<TDimension, TPrecision>(movingImage, field, fixedImage, outputPixels, outputLength);
+}
+
+bool RegistrationServer::SharedMemoryBuffer::Map(const std::string& name, const std::size_t length)
+{
+  this->Address = MapSharedMemory(name, length, false);
+  this->Length = this->Address ? length : 0;
+  return this->Address != NULL;
+}
+
+float* RegistrationServer::SharedMemoryBuffer::GetPixels() const
+{
+  return static_cast<float*>(this->Address);
+}
+
+RegistrationServer::SharedMemoryBuffer::~SharedMemoryBuffer()
+{
+  if(this->Address)
+    {
+    munmap(this->Address, this->Length);
+    }
+}
+
+RegistrationServer::RegistrationServer() : SocketPath(DefaultSocketPath), NumberOfWorkers(2),
+                                           MaximumNumberOfFixedImages(4), ListeningSocket(-1), Stopping(0), Clock(0)
+{
+  pthread_mutex_init(&this->QueueMutex, NULL);
+  pthread_cond_init(&this->QueueCondition, NULL);
+  pthread_mutex_init(&this->CacheMutex, NULL);
+}
+
+RegistrationServer::~RegistrationServer()
+{
+  pthread_mutex_destroy(&this->CacheMutex);
+  pthread_cond_destroy(&this->QueueCondition);
+  pthread_mutex_destroy(&this->QueueMutex);
+}
+
+void RegistrationServer::SetSocketPath(const std::string& socketPath)
+{
+  this->SocketPath = socketPath;
+}
+
+void RegistrationServer::SetNumberOfWorkers(const unsigned int numberOfWorkers)
+{
+  this->NumberOfWorkers = std::max(numberOfWorkers, 1u);
+}
+
+void RegistrationServer::SetMaximumNumberOfFixedImages(const unsigned int maximumNumberOfFixedImages)
+{
+  this->MaximumNumberOfFixedImages = std::max(maximumNumberOfFixedImages, 1u);
+}
+
+void RegistrationServer::Stop()
+{
+  // accept() is interrupted by the signal, and the loop in Run() sees the flag
+  this->Stopping = 1;
+}
+
+bool RegistrationServer::Run()
+{
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if(this->SocketPath.size() >= sizeof(address.sun_path))
+    {
+    std::cerr << "The socket path " << this->SocketPath << " is too long." << std::endl;
+    return false;
+    }
+  strcpy(address.sun_path, this->SocketPath.c_str());
+
+  this->ListeningSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(this->ListeningSocket < 0)
+    {
+    std::cerr << "Could not create the socket: " << strerror(errno) << std::endl;
+    return false;
+    }
+
+  // A socket file left over from a daemon that did not shut down cleanly would make bind() fail. It is only removed
+  // if nothing answers on it, so that a second daemon doesn't take the path from a running one.
+  const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+  const bool running = probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+  if(probe >= 0)
+    {
+    close(probe);
+    }
+  if(running)
+    {
+    std::cerr << "A daemon is already serving on " << this->SocketPath << "." << std::endl;
+    close(this->ListeningSocket);
+    return false;
+    }
+  unlink(this->SocketPath.c_str());
+  if(bind(this->ListeningSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+     listen(this->ListeningSocket, 16) != 0)
+    {
+    std::cerr << "Could not listen on " << this->SocketPath << ": " << strerror(errno) << std::endl;
+    close(this->ListeningSocket);
+    return false;
+    }
+
+  // The workers block the stop signals, so that they interrupt accept() in this thread
+  sigset_t stopSignals;
+  sigemptyset(&stopSignals);
+  sigaddset(&stopSignals, SIGINT);
+  sigaddset(&stopSignals, SIGTERM);
+  sigset_t previousSignals;
+  pthread_sigmask(SIG_BLOCK, &stopSignals, &previousSignals);
+  std::vector<pthread_t> workers(this->NumberOfWorkers);
+  for(unsigned int i = 0; i < workers.size(); ++i)
+    {
+    pthread_create(&workers[i], NULL, WorkerThread, this);
+    }
+  pthread_sigmask(SIG_SETMASK, &previousSignals, NULL);
+  std::cout << "Serving registration jobs on " << this->SocketPath << " with " << workers.size() << " workers." << std::endl;
+
+  while(!this->Stopping)
+    {
+    const int connection = accept(this->ListeningSocket, NULL, NULL);
+    if(connection < 0)
+      {
+      if(errno != EINTR)
+        {
+        std::cerr << "Could not accept a connection: " << strerror(errno) << std::endl;
+        }
+      continue;
+      }
+
+    timeval timeout;
+    timeout.tv_sec = ConnectionTimeout;
+    timeout.tv_usec = 0;
+    setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    pthread_mutex_lock(&this->QueueMutex);
+    this->PendingConnections.push_back(connection);
+    pthread_cond_signal(&this->QueueCondition);
+    pthread_mutex_unlock(&this->QueueMutex);
+    }
+
+  // Stop the workers. Shutting the connections down makes a worker that is waiting on a client give up right away;
+  // jobs that are computing finish, but their replies are not sent. Queued connections are closed unserved.
+  pthread_mutex_lock(&this->QueueMutex);
+  for(std::set<int>::const_iterator iterator = this->ActiveConnections.begin();
+      iterator != this->ActiveConnections.end(); ++iterator)
+    {
+    shutdown(*iterator, SHUT_RDWR);
+    }
+  pthread_cond_broadcast(&this->QueueCondition);
+  pthread_mutex_unlock(&this->QueueMutex);
+  for(unsigned int i = 0; i < workers.size(); ++i)
+    {
+    pthread_join(workers[i], NULL);
+    }
+
+  close(this->ListeningSocket);
+  unlink(this->SocketPath.c_str());
+  std::cout << "Stopped." << std::endl;
+  return true;
+}
+
+void* RegistrationServer::WorkerThread(void* arg)
+{
+  RegistrationServer* server = static_cast<RegistrationServer*>(arg);
+  while(true)
+    {
+    pthread_mutex_lock(&server->QueueMutex);
+    while(server->PendingConnections.empty() && !server->Stopping)
+      {
+      pthread_cond_wait(&server->QueueCondition, &server->QueueMutex);
+      }
+    if(server->PendingConnections.empty())
+      {
+      pthread_mutex_unlock(&server->QueueMutex);
+      return NULL;
+      }
+    const int connection = server->PendingConnections.front();
+    server->PendingConnections.pop_front();
+    // Once stopping, Run() no longer shuts connections down, so they are not served
+    const bool stopping = server->Stopping;
+    if(!stopping)
+      {
+      server->ActiveConnections.insert(connection);
+      }
+    pthread_mutex_unlock(&server->QueueMutex);
+
+    if(!stopping)
+      {
+      server->ServeConnection(connection);
+      }
+
+    // Removed before it is closed, so Run() never shuts down a descriptor that was reused
+    pthread_mutex_lock(&server->QueueMutex);
+    server->ActiveConnections.erase(connection);
+    pthread_mutex_unlock(&server->QueueMutex);
+    close(connection);
+    }
+}
+
+void RegistrationServer::ServeConnection(const int connection)
+{
+  JobRequest request;
+  if(!Receive(connection, &request, sizeof(request)))
+    {
+    std::cerr << "Could not read a job request." << std::endl;
+    return;
+    }
+
+  JobReply reply;
+  memset(&reply, 0, sizeof(reply));
+  reply.Status = JobFailed;
+  std::vector<double> leaveOneOutErrors;
+
+  // Names from the client are terminated here, so they can be used as strings
+  request.FixedImageKey[MaximumNameLength - 1] = '\0';
+  request.FixedImage.SharedMemoryName[MaximumNameLength - 1] = '\0';
+  request.MovingImage.SharedMemoryName[MaximumNameLength - 1] = '\0';
+  request.OutputSharedMemoryName[MaximumNameLength - 1] = '\0';
+
+  // The client may only name its own shared memory objects
+  std::string clientPrefix;
+  ucred credentials;
+  socklen_t credentialsLength = sizeof(credentials);
+  if(getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials, &credentialsLength) == 0)
+    {
+    clientPrefix = GetClientPrefix(credentials.pid);
+    }
+
+  if(request.Version != Version)
+    {
+    SetName(reply.Message, "Unsupported protocol version");
+    }
+  else if(clientPrefix.empty() ||
+          (request.FixedImage.SharedMemoryName[0] != '\0' && !HasPrefix(request.FixedImage.SharedMemoryName, clientPrefix)) ||
+          !HasPrefix(request.MovingImage.SharedMemoryName, clientPrefix) ||
+          !HasPrefix(request.OutputSharedMemoryName, clientPrefix))
+    {
+    SetName(reply.Message, "Shared memory names must start with " + clientPrefix);
+    }
+  else if(request.Dimension < 2 || request.Dimension > MaximumDimension)
+    {
+    SetName(reply.Message, "Only 2D images and volumes are supported");
+    }
+  else if(request.NumberOfLandmarks == 0 || request.NumberOfLandmarks > MaximumNumberOfLandmarks)
+    {
+    SetName(reply.Message, "Too few or too many landmarks");
+    }
+  else
+    {
+    std::vector<double> landmarks(2 * request.NumberOfLandmarks * request.Dimension);
+    if(!landmarks.empty() && !Receive(connection, &landmarks[0], landmarks.size() * sizeof(double)))
+      {
+      std::cerr << "Could not read the landmarks of a job." << std::endl;
+      return;
+      }
+    ProcessJob(request, landmarks, reply, leaveOneOutErrors);
+    }
+
+  // The errors are only sent with a successful job, which has a valid dimension
+  if(reply.Status == JobSucceeded)
+    {
+    reply.NumberOfLandmarks = leaveOneOutErrors.size() / request.Dimension;
+    }
+  else
+    {
+    leaveOneOutErrors.clear();
+    }
+  if(!Send(connection, &reply, sizeof(reply)) ||
+     (!leaveOneOutErrors.empty() && !Send(connection, &leaveOneOutErrors[0], leaveOneOutErrors.size() * sizeof(double))))
+    {
+    std::cerr << "Could not send a job reply." << std::endl;
+    }
+}
+
+void RegistrationServer::ProcessJob(const JobRequest& request, const std::vector<double>& landmarks,
+                                    JobReply& reply, std::vector<double>& leaveOneOutErrors)
+{
+  std::string message;
+  FixedImageEntry fixedEntry;
+  reply.Status = GetFixedImage(request, fixedEntry, message);
+  if(reply.Status != JobSucceeded)
+    {
+    SetName(reply.Message, message);
+    return;
+    }
+
+  bool succeeded = false;
+  try
+    {
+    if(request.Dimension == 2)
+      {
+      succeeded = Register<2>(request, landmarks, fixedEntry, leaveOneOutErrors, message);
+      }
+    else
+      {
+      succeeded = Register<3>(request, landmarks, fixedEntry, leaveOneOutErrors, message);
+      }
+    }
+  catch(itk::ExceptionObject& error)
+    {
+    std::cerr << "Registration job failed: " << error << std::endl;
+    message = error.GetDescription();
+    }
+
+  if(succeeded)
+    {
+    UpdateDerivedData(request.FixedImageKey, fixedEntry);
+    }
+  reply.Status = succeeded ? JobSucceeded : JobFailed;
+  SetName(reply.Message, message);
+}
+
+JobStatus RegistrationServer::GetFixedImage(const JobRequest& request, FixedImageEntry& fixedEntry,
+                                            std::string& message)
+{
+  const std::string key = request.FixedImageKey;
+  const ImageDescription& description = request.FixedImage;
+
+  // Sending the pixels replaces whatever the daemon has under the key
+  if(description.SharedMemoryName[0] != '\0')
+    {
+    if(!IsValid(description, request.Dimension))
+      {
+      message = "Invalid fixed image description";
+      return JobFailed;
+      }
+
+    SharedMemoryBuffer::Pointer buffer = SharedMemoryBuffer::New();
+    if(!buffer->Map(description.SharedMemoryName, GetBufferSize(description, request.Dimension)))
+      {
+      message = "Could not map the fixed image";
+      return JobFailed;
+      }
+
+    // The daemon keeps its own copy, which the client can't change behind the cached field. The mapping goes
+    // away with 'buffer'.
+    FixedImageEntry entry;
+    entry.Dimension = request.Dimension;
+    if(request.Dimension == 2)
+      {
+      entry.Image = CopyImage<ImageTypes<2>::FloatVectorImageType>(description, buffer->GetPixels()).GetPointer();
+      }
+    else
+      {
+      entry.Image = CopyImage<ImageTypes<3>::FloatVectorImageType>(description, buffer->GetPixels()).GetPointer();
+      }
+
+    pthread_mutex_lock(&this->CacheMutex);
+    this->FixedImages[key] = entry;
+    // Drop the least recently used images. Jobs still using one keep their own copy of its entry.
+    while(this->FixedImages.size() > this->MaximumNumberOfFixedImages)
+      {
+      FixedImageMapType::iterator oldest = this->FixedImages.begin();
+      for(FixedImageMapType::iterator iterator = this->FixedImages.begin(); iterator != this->FixedImages.end(); ++iterator)
+        {
+        if(iterator->first != key && (oldest->first == key || iterator->second.LastUse < oldest->second.LastUse))
+          {
+          oldest = iterator;
+          }
+        }
+      std::cout << "Dropping fixed image " << oldest->first << std::endl;
+      this->FixedImages.erase(oldest);
+      }
+    pthread_mutex_unlock(&this->CacheMutex);
+    }
+
+  pthread_mutex_lock(&this->CacheMutex);
+  FixedImageMapType::iterator iterator = this->FixedImages.find(key);
+  const bool found = iterator != this->FixedImages.end();
+  if(found)
+    {
+    iterator->second.LastUse = this->Clock++;
+    fixedEntry = iterator->second;
+    }
+  pthread_mutex_unlock(&this->CacheMutex);
+
+  if(!found)
+    {
+    message = "The fixed image is not resident, send its pixels";
+    return UnknownFixedImage;
+    }
+  if(fixedEntry.Dimension != request.Dimension)
+    {
+    message = "The resident fixed image has a different dimension";
+    return JobFailed;
+    }
+  return JobSucceeded;
+}
+
+void RegistrationServer::UpdateDerivedData(const std::string& key, const FixedImageEntry& fixedEntry)
+{
+  pthread_mutex_lock(&this->CacheMutex);
+  FixedImageMapType::iterator iterator = this->FixedImages.find(key);
+  // Only if the image was not replaced while the job ran
+  if(iterator != this->FixedImages.end() && iterator->second.Image == fixedEntry.Image)
+    {
+    iterator->second.Landmarks = fixedEntry.Landmarks;
+    iterator->second.Precision = fixedEntry.Precision;
+    iterator->second.DeformationField = fixedEntry.DeformationField;
+    iterator->second.LeaveOneOutErrors = fixedEntry.LeaveOneOutErrors;
+    }
+  pthread_mutex_unlock(&this->CacheMutex);
+}
+
+template <unsigned int TDimension>
+bool RegistrationServer::Register(const JobRequest& request, const std::vector<double>& landmarks,
+                                  FixedImageEntry& fixedEntry, std::vector<double>& leaveOneOutErrors,
+                                  std::string& message)
+{
+  typedef typename ImageTypes<TDimension>::FloatVectorImageType ImageType;
+  typedef typename ImageTypes<TDimension>::PointType PointType;
+
+  ImageType* fixedImage = dynamic_cast<ImageType*>(fixedEntry.Image.GetPointer());
+
+  // The moving image is only needed for this job. Its mapping goes away with 'movingBuffer'.
+  if(!IsValid(request.MovingImage, TDimension))
+    {
+    message = "Invalid moving image description";
+    return false;
+    }
+  SharedMemoryBuffer::Pointer movingBuffer = SharedMemoryBuffer::New();
+  if(!movingBuffer->Map(request.MovingImage.SharedMemoryName, GetBufferSize(request.MovingImage, TDimension)))
+    {
+    message = "Could not map the moving image";
+    return false;
+    }
+  typename ImageType::Pointer movingImage = ImportImage<ImageType>(request.MovingImage, movingBuffer->GetPixels());
+
+  // The output has the fixed grid and the moving components. It is mapped before anything is computed, and the
+  // resampler writes into it directly.
+  ImageDescription outputDescription = request.FixedImage;
+  outputDescription.NumberOfComponents = request.MovingImage.NumberOfComponents;
+  for(unsigned int i = 0; i < TDimension; ++i)
+    {
+    outputDescription.Size[i] = fixedImage->GetLargestPossibleRegion().GetSize()[i];
+    }
+  const std::size_t outputSize = GetBufferSize(outputDescription, TDimension);
+  SharedMemoryBuffer::Pointer outputBuffer = SharedMemoryBuffer::New();
+  if(outputSize == 0 || !outputBuffer->Map(request.OutputSharedMemoryName, outputSize))
+    {
+    message = "Could not map the output image";
+    return false;
+    }
+  float* outputPixels = outputBuffer->GetPixels();
+  const std::size_t outputLength = outputSize / sizeof(float);
+
+  const unsigned int numberOfLandmarks = request.NumberOfLandmarks;
+  std::vector<PointType> fixedLandmarks(numberOfLandmarks);
+  std::vector<PointType> movingLandmarks(numberOfLandmarks);
+  for(unsigned int i = 0; i < numberOfLandmarks; ++i)
+    {
+    for(unsigned int j = 0; j < TDimension; ++j)
+      {
+      fixedLandmarks[i][j] = landmarks[i * TDimension + j];
+      movingLandmarks[i][j] = landmarks[(numberOfLandmarks + i) * TDimension + j];
+      }
+    }
+
+  // The field of the fixed image's last job is reused if it came from the same landmarks and precision
+  if(fixedEntry.Landmarks != landmarks || fixedEntry.Precision != request.Precision)
+    {
+    fixedEntry.DeformationField = NULL;
+    fixedEntry.Landmarks = landmarks;
+    fixedEntry.Precision = request.Precision;
+    }
+  else
+    {
+    std::cout << "Reusing the deformation field of fixed image " << request.FixedImageKey << std::endl;
+    }
+
+  switch(request.Precision)
+    {
+    case FloatPrecisionPolicy:
+      RegisterWithPrecision<TDimension, FloatPrecision>(fixedImage, movingImage, fixedLandmarks, movingLandmarks,
+                                                        outputPixels, outputLength, fixedEntry.DeformationField,
+                                                        fixedEntry.LeaveOneOutErrors);
+      break;
+    case MixedPrecisionPolicy:
+      RegisterWithPrecision<TDimension, MixedPrecision>(fixedImage, movingImage, fixedLandmarks, movingLandmarks,
+                                                        outputPixels, outputLength, fixedEntry.DeformationField,
+                                                        fixedEntry.LeaveOneOutErrors);
+      break;
+    default:
+      RegisterWithPrecision<TDimension, DoublePrecision>(fixedImage, movingImage, fixedLandmarks, movingLandmarks,
+                                                         outputPixels, outputLength, fixedEntry.DeformationField,
+                                                         fixedEntry.LeaveOneOutErrors);
+      break;
+    }
+  leaveOneOutErrors = fixedEntry.LeaveOneOutErrors;
+
+  std::stringstream ss;
+  ss << "Registered with " << numberOfLandmarks << " landmarks in " << GetPrecisionPolicyName(
+    static_cast<PrecisionPolicyType>(request.Precision)) << " precision";
+  message = ss.str();
+  return true;
+}
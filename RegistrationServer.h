@@ -0,0 +1,135 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef REGISTRATIONSERVER_H
+#define REGISTRATIONSERVER_H
+
+// STL
+#include <csignal>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// POSIX
+#include <pthread.h>
+
+// ITK
+#include "itkDataObject.h"
+#include "itkLightObject.h"
+#include "itkObjectFactory.h"
+
+// Custom
+#include "RegistrationProtocol.h"
+
+// Serves landmark registration jobs (see RegistrationProtocol.h) to local processes, with the same registration core
+// as the application. Connections are queued and handled by a pool of worker threads, one job per connection.
+// Fixed images are copied into the daemon and stay resident between jobs, keyed by the client's name for them,
+// together with the deformation field of their last job, which is reused when the next job has the same landmarks
+// and precision (e.g. warping each channel of a moving image in turn). Moving pixels are used in place in shared
+// memory, and the warped image is resampled straight into the client's output object, so neither is copied.
+class RegistrationServer
+{
+public:
+  RegistrationServer();
+  ~RegistrationServer();
+
+  void SetSocketPath(const std::string& socketPath);
+  void SetNumberOfWorkers(const unsigned int numberOfWorkers);
+
+  // The least recently used fixed image is dropped when there would be more than this many
+  void SetMaximumNumberOfFixedImages(const unsigned int maximumNumberOfFixedImages);
+
+  // Serve until Stop() is called. Returns false if the socket could not be set up, or another daemon serves on it.
+  bool Run();
+
+  // Safe to call from a signal handler
+  void Stop();
+
+private:
+  // A shared memory mapping, unmapped when the last image that uses it is gone
+  class SharedMemoryBuffer : public itk::LightObject
+  {
+  public:
+    typedef SharedMemoryBuffer Self;
+    typedef itk::LightObject Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    itkNewMacro(Self);
+
+    bool Map(const std::string& name, const std::size_t length);
+    float* GetPixels() const;
+
+  protected:
+    SharedMemoryBuffer() : Address(NULL), Length(0) {}
+    ~SharedMemoryBuffer();
+
+  private:
+    void* Address;
+    std::size_t Length;
+  };
+
+  struct FixedImageEntry
+  {
+    FixedImageEntry() : Dimension(0), LastUse(0), Precision(0) {}
+
+    itk::DataObject::Pointer Image; // An itk::VectorImage of 'Dimension' dimensions
+    unsigned int Dimension;
+    unsigned long LastUse;
+
+    // Derived data: the field of the last job, and what it was computed from
+    std::vector<double> Landmarks;
+    unsigned int Precision;
+    itk::DataObject::Pointer DeformationField;
+    std::vector<double> LeaveOneOutErrors;
+  };
+  typedef std::map<std::string, FixedImageEntry> FixedImageMapType;
+
+  static void* WorkerThread(void* server);
+  void ServeConnection(const int connection);
+  void ProcessJob(const RegistrationProtocol::JobRequest& request, const std::vector<double>& landmarks,
+                  RegistrationProtocol::JobReply& reply, std::vector<double>& leaveOneOutErrors);
+
+  template <unsigned int TDimension>
+  bool Register(const RegistrationProtocol::JobRequest& request, const std::vector<double>& landmarks,
+                FixedImageEntry& fixedEntry, std::vector<double>& leaveOneOutErrors, std::string& message);
+
+  // Find the fixed image of a job, copying it in if the job sends it. The entry returned is a copy, so it stays valid
+  // while the job runs even if the cache drops it.
+  RegistrationProtocol::JobStatus GetFixedImage(const RegistrationProtocol::JobRequest& request,
+                                                FixedImageEntry& fixedEntry, std::string& message);
+  void UpdateDerivedData(const std::string& key, const FixedImageEntry& fixedEntry);
+
+  std::string SocketPath;
+  unsigned int NumberOfWorkers;
+  unsigned int MaximumNumberOfFixedImages;
+  int ListeningSocket;
+  volatile std::sig_atomic_t Stopping;
+
+  std::deque<int> PendingConnections;
+  std::set<int> ActiveConnections; // Being served by a worker
+  pthread_mutex_t QueueMutex;
+  pthread_cond_t QueueCondition;
+
+  FixedImageMapType FixedImages;
+  unsigned long Clock;
+  pthread_mutex_t CacheMutex;
+};
+
+#endif
@@ -0,0 +1,86 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef RESAMPLEINTOBUFFERFILTER_H
+#define RESAMPLEINTOBUFFERFILTER_H
+
+// STL
+#include <cstddef>
+
+// ITK
+#include "itkResampleVectorImageFilter.h"
+
+// A vector resampler that can write its output into memory owned by someone else (e.g. a shared memory segment),
+// instead of allocating it. The output image then wraps that memory and does not free it.
+// Grafting an image onto the output before Update() is not enough: the pipeline re-initializes the output, which
+// replaces its pixel container, before allocating it. So the buffer is put in at allocation time.
+template <typename TInputImage, typename TOutputImage, typename TInterpolatorPrecisionType = double>
+class ResampleIntoBufferFilter
+  : public itk::ResampleVectorImageFilter<TInputImage, TOutputImage, TInterpolatorPrecisionType>
+{
+public:
+  typedef ResampleIntoBufferFilter Self;
+  typedef itk::ResampleVectorImageFilter<TInputImage, TOutputImage, TInterpolatorPrecisionType> Superclass;
+  typedef itk::SmartPointer<Self> Pointer;
+  typedef itk::SmartPointer<const Self> ConstPointer;
+  itkNewMacro(Self);
+  itkTypeMacro(ResampleIntoBufferFilter, ResampleVectorImageFilter);
+
+  typedef typename TOutputImage::InternalPixelType InternalPixelType;
+
+  // 'length' is in InternalPixelType elements. It must hold the whole output, with all its components.
+  // A NULL buffer makes the filter allocate its output as usual.
+  void SetOutputBuffer(InternalPixelType* buffer, const std::size_t length)
+  {
+    this->OutputBuffer = buffer;
+    this->OutputBufferLength = length;
+    this->Modified();
+  }
+
+protected:
+  ResampleIntoBufferFilter() : OutputBuffer(NULL), OutputBufferLength(0) {}
+
+  void AllocateOutputs()
+  {
+    if(!this->OutputBuffer)
+      {
+      Superclass::AllocateOutputs();
+      return;
+      }
+
+    TOutputImage* output = this->GetOutput();
+    output->SetBufferedRegion(output->GetRequestedRegion());
+    output->SetNumberOfComponentsPerPixel(this->GetInput()->GetNumberOfComponentsPerPixel());
+    const std::size_t length = output->GetBufferedRegion().GetNumberOfPixels() * output->GetNumberOfComponentsPerPixel();
+    if(length > this->OutputBufferLength)
+      {
+      itkExceptionMacro(<< "The output buffer holds " << this->OutputBufferLength << " values, the output needs "
+                        << length);
+      }
+    output->GetPixelContainer()->SetImportPointer(this->OutputBuffer, length, false);
+  }
+
+private:
+  ResampleIntoBufferFilter(const Self&); // Not implemented
+  void operator=(const Self&); // Not implemented
+
+  InternalPixelType* OutputBuffer;
+  std::size_t OutputBufferLength;
+};
+
+#endif
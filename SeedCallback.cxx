@@ -35,6 +35,8 @@ void vtkSeedCallback::Execute(vtkObject*, unsigned long event, void *calldata)
 {
   if (event == vtkCommand::PlacePointEvent)
     {
+    this->SeedSlices.push_back(this->Slice);
+
     //std::cout << "Placing point..." << std::endl;
     //std::cout << "There are now " << this->SeedRepresentation->GetNumberOfSeeds() << " seeds." << std::endl;
     for(vtkIdType seedId = 0; seedId < this->SeedRepresentation->GetNumberOfSeeds(); seedId++)
@@ -51,6 +53,7 @@ void vtkSeedCallback::Execute(vtkObject*, unsigned long event, void *calldata)
     ss << this->SeedRepresentation->GetNumberOfSeeds()-1;
     textSource->SetText(ss.str().c_str());
     textSource->Update();
+    this->SeedLabels.push_back(textSource);
   
     // Create a mapper and actor
     vtkSmartPointer<vtkPolyDataMapper> mapper = 
@@ -67,6 +70,7 @@ void vtkSeedCallback::Execute(vtkObject*, unsigned long event, void *calldata)
     actor->SetPosition(pos[0], pos[1], 0);
     //std::cout << "Text pos: " << pos[0] << " " << pos[1] << " " << 0 << std::endl;
     actor->GetProperty()->SetColor(1.0, 0.0, 0.0);
+    this->SeedLabelActors.push_back(actor);
 
     this->SeedWidget->GetInteractor()->GetRenderWindow()->GetRenderers()->GetFirstRenderer()->AddActor(actor);
     
@@ -77,6 +81,14 @@ void vtkSeedCallback::Execute(vtkObject*, unsigned long event, void *calldata)
     }
   if (event == vtkCommand::InteractionEvent)
     {
+    // A seed that is dragged moves to the slice on screen
+    const int activeSeed = this->SeedRepresentation->GetActiveHandle();
+    if(activeSeed >= 0 && activeSeed < static_cast<int>(this->SeedSlices.size()))
+      {
+      this->SeedSlices[activeSeed] = this->Slice;
+      }
+
+    UpdateLabelPositions();
     /*
     std::cout << "Interaction..." << std::endl;
     if (calldata)
@@ -88,6 +100,41 @@ void vtkSeedCallback::Execute(vtkObject*, unsigned long event, void *calldata)
     */
     return;
     }
+  if (event == SeedsMovedEvent)
+    {
+    UpdateLabelPositions();
+    return;
+    }
+  if (event == vtkCommand::DeletePointEvent)
+    {
+    // The widget sends the id of the seed it is about to delete
+    if(calldata)
+      {
+      DeleteSeed(*static_cast<int*>(calldata));
+      }
+    return;
+    }
+}
+
+void vtkSeedCallback::DeleteSeed(const unsigned int seedId)
+{
+  if(seedId < this->SeedSlices.size())
+    {
+    this->SeedSlices.erase(this->SeedSlices.begin() + seedId);
+    }
+  if(seedId < this->SeedLabels.size())
+    {
+    this->SeedWidget->GetInteractor()->GetRenderWindow()->GetRenderers()->GetFirstRenderer()->RemoveActor(
+      this->SeedLabelActors[seedId]);
+    this->SeedLabels.erase(this->SeedLabels.begin() + seedId);
+    this->SeedLabelActors.erase(this->SeedLabelActors.begin() + seedId);
+    }
+
+  // The seeds after it move down one id. Their notes no longer apply to the remaining pairs.
+  for(unsigned int i = seedId; i < this->SeedLabels.size(); ++i)
+    {
+    SetSeedNote(i, "");
+    }
 }
 
 void vtkSeedCallback::SetWidget(vtkSmartPointer<vtkSeedWidget> widget) 
@@ -95,3 +142,47 @@ void vtkSeedCallback::SetWidget(vtkSmartPointer<vtkSeedWidget> widget)
   this->SeedWidget = widget;
   this->SeedRepresentation = vtkSeedRepresentation::SafeDownCast(this->SeedWidget->GetRepresentation());
 }
+
+void vtkSeedCallback::SetSlice(const unsigned int slice)
+{
+  this->Slice = slice;
+}
+
+unsigned int vtkSeedCallback::GetSeedSlice(const unsigned int seedId) const
+{
+  if(seedId >= this->SeedSlices.size())
+    {
+    return 0;
+    }
+  return this->SeedSlices[seedId];
+}
+
+void vtkSeedCallback::UpdateLabelPositions()
+{
+  for(unsigned int seedId = 0; seedId < this->SeedLabelActors.size(); ++seedId)
+    {
+    if(static_cast<int>(seedId) >= this->SeedRepresentation->GetNumberOfSeeds())
+      {
+      break;
+      }
+    double pos[3];
+    this->SeedRepresentation->GetSeedWorldPosition(seedId, pos);
+    this->SeedLabelActors[seedId]->SetPosition(pos[0], pos[1], 0);
+    }
+}
+
+void vtkSeedCallback::SetSeedNote(const unsigned int seedId, const std::string& note)
+{
+  if(seedId >= this->SeedLabels.size())
+    {
+    return;
+    }
+
+  std::stringstream ss;
+  ss << seedId;
+  if(!note.empty())
+    {
+    ss << " " << note;
+    }
+  this->SeedLabels[seedId]->SetText(ss.str().c_str());
+}
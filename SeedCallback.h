@@ -23,6 +23,12 @@
 #include <vtkSeedWidget.h>
 #include <vtkSmartPointer.h>
 
+#include <string>
+#include <vector>
+
+class vtkActor;
+class vtkVectorText;
+
 class vtkSeedCallback : public vtkCommand
 {
   public:
@@ -31,15 +37,37 @@ class vtkSeedCallback : public vtkCommand
       return new vtkSeedCallback; 
     }
     
-    vtkSeedCallback() {}
+    vtkSeedCallback() : Slice(0) {}
+
+    // Raised on the widget when seeds are moved by the program rather than dragged (see Helpers::SetSeedIndices).
+    // Only the labels are updated, the slices of the seeds are kept.
+    enum {SeedsMovedEvent = vtkCommand::UserEvent + 1};
     
     virtual void Execute(vtkObject*, unsigned long event, void *calldata);
 
     void SetWidget(vtkSmartPointer<vtkSeedWidget> widget);
+
+    // When a volume is shown, each seed remembers the slice that was on screen when it was placed or last moved
+    void SetSlice(const unsigned int slice);
+    unsigned int GetSeedSlice(const unsigned int seedId) const;
+
+    // Each seed is labeled with its id. The note (e.g. its registration error) is shown after the id.
+    void SetSeedNote(const unsigned int seedId, const std::string& note);
     
   private:
+    // Move the labels to where their seeds are now
+    void UpdateLabelPositions();
+
+    // Forget the slice and label of a seed that the widget is deleting
+    void DeleteSeed(const unsigned int seedId);
+
     vtkSeedRepresentation* SeedRepresentation;
     vtkSeedWidget* SeedWidget;
+
+    unsigned int Slice;
+    std::vector<unsigned int> SeedSlices;
+    std::vector<vtkSmartPointer<vtkVectorText> > SeedLabels;
+    std::vector<vtkSmartPointer<vtkActor> > SeedLabelActors;
 };
 
 #endif
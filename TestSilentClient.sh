@@ -0,0 +1,53 @@
+#!/bin/sh
+# Checks that a client that connects to RegistrationDaemon and never sends anything neither keeps the daemon from
+# serving other clients nor from exiting on SIGTERM.
+# Usage: TestSilentClient.sh [buildDirectory]   (run from the source directory, needs python3)
+
+binaries=${1:-.}
+work=$(mktemp -d)
+socket=$work/daemon.sock
+daemon=
+silent=
+
+finish()
+{
+  [ -n "$silent" ] && kill $silent 2>/dev/null
+  [ -n "$daemon" ] && kill -KILL $daemon 2>/dev/null
+  rm -rf "$work"
+  if [ "$1" -eq 0 ]; then echo "Passed."; else echo "Failed: $2"; fi
+  exit $1
+}
+
+# The same pairs in both images, so the job is well posed
+printf "20 20\n80 20\n20 80\n80 80\n50 50\n" > "$work/landmarks.txt"
+
+"$binaries/RegistrationDaemon" "$socket" 2 &
+daemon=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do
+  [ -S "$socket" ] && break
+  sleep 1
+done
+[ -S "$socket" ] || finish 1 "the daemon did not start"
+
+# Takes a worker and holds it without sending a request
+python3 -c "
+import socket, sys, time
+client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+client.connect(sys.argv[1])
+time.sleep(600)
+" "$socket" &
+silent=$!
+sleep 1
+
+"$binaries/RegistrationClient" data/fixed.png data/moving.png "$work/landmarks.txt" "$work/landmarks.txt" \
+  "$work/output.mhd" double "$socket" || finish 1 "another client was not served"
+
+kill -TERM $daemon
+for i in 1 2 3 4 5 6 7 8 9 10; do
+  kill -0 $daemon 2>/dev/null || break
+  sleep 1
+done
+kill -0 $daemon 2>/dev/null && finish 1 "the daemon did not exit on SIGTERM"
+wait $daemon || finish 1 "the daemon exited with an error"
+daemon=
+finish 0
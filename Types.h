@@ -19,13 +19,46 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include "itkContinuousIndex.h"
 #include "itkImage.h"
+#include "itkPoint.h"
+#include "itkVector.h"
 #include "itkVectorImage.h"
 
-typedef itk::VectorImage<float,2> FloatVectorImageType;
-typedef itk::VectorImage<unsigned char,2> UnsignedCharVectorImageType;
+template <unsigned int TDimension>
+struct ImageTypes
+{
+  typedef itk::VectorImage<float,TDimension> FloatVectorImageType;
+  typedef itk::VectorImage<unsigned char,TDimension> UnsignedCharVectorImageType;
 
-typedef itk::Image<float,2> FloatScalarImageType;
-typedef itk::Image<unsigned char,2> UnsignedCharScalarImageType;
+  typedef itk::Image<float,TDimension> FloatScalarImageType;
+  typedef itk::Image<unsigned char,TDimension> UnsignedCharScalarImageType;
+
+  typedef itk::ContinuousIndex<double,TDimension> ContinuousIndexType;
+  typedef itk::Point<double,TDimension> PointType;
+
+  typedef itk::Vector<double,TDimension> DeformationVectorType;
+  typedef itk::Image<DeformationVectorType,TDimension> DeformationFieldType;
+};
+
+// Images
+typedef ImageTypes<2>::FloatVectorImageType FloatVectorImageType;
+typedef ImageTypes<2>::UnsignedCharVectorImageType UnsignedCharVectorImageType;
+
+typedef ImageTypes<2>::FloatScalarImageType FloatScalarImageType;
+typedef ImageTypes<2>::UnsignedCharScalarImageType UnsignedCharScalarImageType;
+
+typedef ImageTypes<2>::ContinuousIndexType ContinuousIndexType;
+
+typedef ImageTypes<2>::DeformationVectorType DeformationVectorType;
+typedef ImageTypes<2>::DeformationFieldType DeformationFieldType;
+
+// Volumes
+typedef ImageTypes<3>::FloatVectorImageType FloatVectorVolumeType;
+typedef ImageTypes<3>::UnsignedCharVectorImageType UnsignedCharVectorVolumeType;
+
+typedef ImageTypes<3>::ContinuousIndexType VolumeContinuousIndexType;
+
+typedef ImageTypes<3>::DeformationFieldType VolumeDeformationFieldType;
 
 #endif